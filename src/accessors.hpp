@@ -0,0 +1,135 @@
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+int getElementSize(const Buffer &g) {
+    return g.byteStride > 0 ? g.byteStride : g.components * getCount(g.componentType);
+}
+
+std::vector<uint32_t> readSparseIndices(const Buffer &g, const std::vector<unsigned char> &buffer) {
+    std::vector<uint32_t> r(g.sparse.count);
+    const unsigned char *p = buffer.data() + g.sparse.indicesOffset;
+    int size = getCount(g.sparse.indicesComponentType);
+    for (int i = 0; i < g.sparse.count; i++) {
+        uint32_t v = 0;
+        memcpy(&v, p + i * size, size);
+        r[i] = v;
+    }
+    return r;
+}
+
+// Dense copy of a sparse accessor or of one without a bufferView: the base (or zeros) plus the sparse values.
+void materialize(Buffer &g, const std::vector<unsigned char> &buffer) {
+    int size = g.components * getCount(g.componentType);
+    g.data.assign(g.count * size, 0);
+    if (g.offset >= 0) {
+        int stride = getElementSize(g);
+        for (int i = 0; i < g.count; i++) {
+            memcpy(g.data.data() + i * size, buffer.data() + g.offset + i * stride, size);
+        }
+    }
+    std::vector<uint32_t> indices = readSparseIndices(g, buffer);
+    for (int i = 0; i < g.sparse.count; i++) {
+        if (indices[i] < (uint32_t)g.count) {
+            memcpy(g.data.data() + indices[i] * size, buffer.data() + g.sparse.valuesOffset + i * size, size);
+        }
+    }
+    g.byteStride = 0;
+    g.length = g.data.size();
+}
+
+// Sparse accessors are only expanded here, the first time someone needs dense data.
+const unsigned char *getData(Buffer &g, const std::vector<unsigned char> &buffer) {
+    if (g.data.empty() && (g.offset < 0 || g.sparse.count > 0) && g.count > 0) {
+        materialize(g, buffer);
+    }
+    return g.data.empty() ? buffer.data() + g.offset : g.data.data();
+}
+
+float readComponent(const unsigned char *p, int componentType, bool normalized) {
+    switch (componentType) {
+        case 5120: {
+            float v = (float)*(const int8_t *)p;
+            return normalized ? fmaxf(v / 127.0f, -1.0f) : v;
+        }
+        case 5121: {
+            float v = (float)*p;
+            return normalized ? v / 255.0f : v;
+        }
+        case 5122: {
+            int16_t s;
+            memcpy(&s, p, 2);
+            return normalized ? fmaxf(s / 32767.0f, -1.0f) : (float)s;
+        }
+        case 5123: {
+            uint16_t s;
+            memcpy(&s, p, 2);
+            return normalized ? s / 65535.0f : (float)s;
+        }
+        case 5125: {
+            uint32_t s;
+            memcpy(&s, p, 4);
+            return (float)s;
+        }
+        default: {
+            float f;
+            memcpy(&f, p, 4);
+            return f;
+        }
+    }
+}
+
+// dense float copy of an accessor, count * components values
+std::vector<float> readFloats(Buffer &g, const std::vector<unsigned char> &buffer) {
+    std::vector<float> r(g.count * g.components);
+    const unsigned char *p = getData(g, buffer);
+    int elementSize = getElementSize(g);
+    int componentSize = getCount(g.componentType);
+    if (g.componentType == 5126 && elementSize == g.components * 4) {
+        memcpy(r.data(), p, r.size() * sizeof(float));
+        return r;
+    }
+    for (int i = 0; i < g.count; i++) {
+        for (int c = 0; c < g.components; c++) {
+            r[i * g.components + c] = readComponent(p + i * elementSize + c * componentSize, g.componentType, g.normalized);
+        }
+    }
+    return r;
+}
+
+std::vector<uint32_t> readIndices(Buffer &g, const std::vector<unsigned char> &buffer) {
+    std::vector<uint32_t> r(g.count);
+    const unsigned char *p = getData(g, buffer);
+    for (int i = 0; i < g.count; i++) {
+        switch (g.componentType) {
+            case 5121:
+                r[i] = p[i];
+                break;
+            case 5123: {
+                uint16_t s;
+                memcpy(&s, p + i * 2, 2);
+                r[i] = s;
+                break;
+            }
+            default:
+                memcpy(&r[i], p + i * 4, 4);
+                break;
+        }
+    }
+    return r;
+}
+
+AttributeFormat getAttributeFormat(std::vector<Buffer> &geometries, int accessor) {
+    if (accessor == -1) {
+        return AttributeFormat{5126, 0, 0, 0};
+    }
+    Buffer &g = geometries[accessor];
+    return AttributeFormat{(uint32_t)g.componentType, g.normalized, (uint32_t)getElementSize(g), (uint32_t)g.components};
+}
+
+VertexLayout getVertexLayout(Geometry &g, std::vector<Buffer> &geometries) {
+    return VertexLayout{getAttributeFormat(geometries, g.position),
+                        getAttributeFormat(geometries, g.normal),
+                        getAttributeFormat(geometries, g.uv),
+                        getAttributeFormat(geometries, g.tangent)};
+}
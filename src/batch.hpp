@@ -0,0 +1,141 @@
+#include <cmath>
+#include <cstdint>
+#include <iostream>
+#include <map>
+#include <tuple>
+#include <vector>
+
+// Static batching: primitives sharing a glTF material and the same set of attributes are pre-transformed by their
+// node matrix and merged into one float vertex stream per attribute and one 32 bit index buffer. Every source
+// primitive stays a contiguous index range, kept as a coarse meshlet so draw() can still frustum cull it; with
+// BUILD_MESHLETS buildClusters() splits each range further.
+// Returns the per mesh ranges for the clusters of the renderer, empty when nothing was merged.
+std::vector<Meshlets> batchMeshes(std::vector<Mesh> &meshes,
+                                  std::vector<glm::mat4> &matricies,
+                                  std::vector<Buffer> &geometries,
+                                  const std::vector<unsigned char> &buffer) {
+    typedef std::tuple<int, bool, bool> Key;
+    std::map<Key, std::vector<size_t>> groups;
+    for (size_t i = 0; i < meshes.size() && i < matricies.size(); i++) {
+        Geometry *g = meshes[i].geometry;
+        if (meshes[i].materialIndex == -1 || !g->lods.empty() || g->normal == -1) {
+            continue;
+        }
+        groups[Key{meshes[i].materialIndex, g->uv != -1, g->tangent != -1}].push_back(i);
+    }
+
+    std::vector<Mesh> batched;
+    std::vector<glm::mat4> batchedMatricies;
+    std::vector<Meshlets> ranges;
+    std::vector<bool> merged(meshes.size(), false);
+    size_t before = meshes.size();
+    for (auto &[key, members] : groups) {
+        if (members.size() < 2) {
+            continue;
+        }
+        std::vector<float> positions, normals, uvs, tangents;
+        std::vector<uint32_t> indices;
+        Meshlets r;
+        for (size_t i : members) {
+            Geometry *g = meshes[i].geometry;
+            glm::mat4 &model = matricies[i];
+            // a mirroring transform flips the handedness of the tangent frame and the winding of the triangles
+            bool mirrored = glm::determinant(glm::mat3(model)) < 0.0f;
+            glm::mat3 normalMatrix = glm::transpose(glm::inverse(glm::mat3(model)));
+            uint32_t base = positions.size() / 3;
+
+            Meshlet m{};
+            m.indexOffset = indices.size();
+            std::vector<uint32_t> source = readIndices(geometries[g->index], buffer);
+            for (size_t k = 0; k + 2 < source.size(); k += 3) {
+                indices.insert(indices.end(), {base + source[k], base + source[k + (mirrored ? 2 : 1)],
+                                               base + source[k + (mirrored ? 1 : 2)]});
+            }
+            m.triangleCount = (indices.size() - m.indexOffset) / 3;
+
+            std::vector<float> p = readFloats(geometries[g->position], buffer);
+            std::vector<float> n = readFloats(geometries[g->normal], buffer);
+            float min[3] = {INFINITY, INFINITY, INFINITY};
+            float max[3] = {-INFINITY, -INFINITY, -INFINITY};
+            for (size_t v = 0; v < p.size() / 3; v++) {
+                glm::vec4 w = model * glm::vec4(p[v * 3], p[v * 3 + 1], p[v * 3 + 2], 1.0f);
+                glm::vec3 nw = glm::normalize(normalMatrix * glm::vec3(n[v * 3], n[v * 3 + 1], n[v * 3 + 2]));
+                positions.insert(positions.end(), {w.x, w.y, w.z});
+                normals.insert(normals.end(), {nw.x, nw.y, nw.z});
+                for (int c = 0; c < 3; c++) {
+                    min[c] = fminf(min[c], w[c]);
+                    max[c] = fmaxf(max[c], w[c]);
+                }
+            }
+            if (g->uv != -1) {
+                std::vector<float> t = readFloats(geometries[g->uv], buffer);
+                uvs.insert(uvs.end(), t.begin(), t.end());
+            }
+            if (g->tangent != -1) {
+                std::vector<float> t = readFloats(geometries[g->tangent], buffer);
+                for (size_t v = 0; v < t.size() / 4; v++) {
+                    glm::vec4 tw = model * glm::vec4(t[v * 4], t[v * 4 + 1], t[v * 4 + 2], 0.0f);
+                    glm::vec3 tn = glm::normalize(glm::vec3(tw));
+                    tangents.insert(tangents.end(), {tn.x, tn.y, tn.z, mirrored ? -t[v * 4 + 3] : t[v * 4 + 3]});
+                }
+            }
+
+            float radius = 0.0f;
+            for (int c = 0; c < 3; c++) {
+                m.center[c] = (min[c] + max[c]) * 0.5f;
+                radius += (max[c] - min[c]) * (max[c] - min[c]) * 0.25f;
+            }
+            m.radius = sqrtf(radius);
+            m.coneCutoff = 1.0f;
+            r.meshlets.push_back(m);
+            merged[i] = true;
+        }
+        buildMeshletBounds(r);
+
+        Geometry *g = new Geometry{-1, -1, -1, -1, -1};
+        Buffer b{0, (int)(indices.size() * 4), (int)indices.size(), 4, 0};
+        b.componentType = 5125;
+        b.data.resize(b.length);
+        memcpy(b.data.data(), indices.data(), b.length);
+        geometries.push_back(std::move(b));
+        g->index = geometries.size() - 1;
+        geometries.push_back(makeFloatBuffer(positions, 3));
+        g->position = geometries.size() - 1;
+        geometries.push_back(makeFloatBuffer(normals, 3));
+        g->normal = geometries.size() - 1;
+        if (!uvs.empty()) {
+            geometries.push_back(makeFloatBuffer(uvs, 2));
+            g->uv = geometries.size() - 1;
+        }
+        if (!tangents.empty()) {
+            geometries.push_back(makeFloatBuffer(tangents, 4));
+            g->tangent = geometries.size() - 1;
+        }
+
+        Mesh mesh{g, meshes[members[0]].material};
+        mesh.materialIndex = std::get<0>(key);
+        batched.push_back(mesh);
+        batchedMatricies.push_back(glm::mat4(1.0f));
+        ranges.push_back(std::move(r));
+    }
+    if (batched.empty()) {
+        return {};
+    }
+
+    std::vector<Mesh> keptMeshes;
+    std::vector<glm::mat4> keptMatricies;
+    for (size_t i = 0; i < meshes.size(); i++) {
+        if (!merged[i]) {
+            keptMeshes.push_back(meshes[i]);
+            keptMatricies.push_back(i < matricies.size() ? matricies[i] : glm::mat4(1.0f));
+        }
+    }
+    std::vector<Meshlets> r(keptMeshes.size());
+    keptMeshes.insert(keptMeshes.end(), batched.begin(), batched.end());
+    keptMatricies.insert(keptMatricies.end(), batchedMatricies.begin(), batchedMatricies.end());
+    r.insert(r.end(), std::make_move_iterator(ranges.begin()), std::make_move_iterator(ranges.end()));
+    meshes = std::move(keptMeshes);
+    matricies = std::move(keptMatricies);
+    std::cout << "batching: " << before << " meshes -> " << meshes.size() << " draws" << std::endl;
+    return r;
+}
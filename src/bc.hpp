@@ -0,0 +1,454 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <future>
+#include <iostream>
+#include <vector>
+
+// CPU encoders for the block formats picked per texture role: BC7 (mode 6 only) for color and other RGBA data,
+// BC5 for normals (the shader rebuilds z) and BC4 for single channel data. Blocks are 4x4 texels, partial edge
+// blocks repeat the last row / column.
+
+// bump when the encoders' output changes, so cached blocks are not reused
+const uint64_t BC_ENCODER_VERSION = 1;
+
+const int kBC7Weights4[16] = {0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64};
+
+int getBlockBytes(BlockFormat format) {
+    return format == BlockBC4 ? 8 : 16;
+}
+
+BlockFormat getBlockFormat(TextureRole role) {
+    switch (role) {
+        case TextureNormal:
+            return BlockBC5;
+        case TextureOcclusion:
+            return BlockBC4;
+        default:
+            return BlockBC7;
+    }
+}
+
+struct BitWriter {
+    uint8_t *out;
+    int position = 0;
+
+    void write(uint32_t value, int bits) {
+        for (int i = 0; i < bits; i++, position++) {
+            out[position >> 3] |= ((value >> i) & 1) << (position & 7);
+        }
+    }
+};
+
+struct BitReader {
+    const uint8_t *in;
+    int position = 0;
+
+    uint32_t read(int bits) {
+        uint32_t r = 0;
+        for (int i = 0; i < bits; i++, position++) {
+            r |= ((in[position >> 3] >> (position & 7)) & 1) << i;
+        }
+        return r;
+    }
+};
+
+// 7 bit endpoint plus the p-bit shared by its four channels, picked for the smallest error
+void quantizeEndpoint(const float *e, uint8_t *q, uint8_t &p) {
+    float best = INFINITY;
+    for (int bit = 0; bit < 2; bit++) {
+        uint8_t candidate[4];
+        float error = 0.0f;
+        for (int c = 0; c < 4; c++) {
+            int v = (int)roundf((e[c] - bit) * 0.5f);
+            candidate[c] = std::clamp(v, 0, 127);
+            float d = candidate[c] * 2 + bit - e[c];
+            error += d * d;
+        }
+        if (error < best) {
+            best = error;
+            p = bit;
+            memcpy(q, candidate, 4);
+        }
+    }
+}
+
+// Nearest of the 16 palette entries per texel, returns the squared error of the block.
+float findBC7Indices(const uint8_t pixels[16][4], const uint8_t *q0, uint8_t p0, const uint8_t *q1, uint8_t p1,
+                     uint8_t *indices) {
+    int palette[16][4];
+    for (int i = 0; i < 16; i++) {
+        for (int c = 0; c < 4; c++) {
+            int a = q0[c] * 2 + p0, b = q1[c] * 2 + p1;
+            palette[i][c] = ((64 - kBC7Weights4[i]) * a + kBC7Weights4[i] * b + 32) >> 6;
+        }
+    }
+    float total = 0.0f;
+    for (int t = 0; t < 16; t++) {
+        int best = INT32_MAX;
+        for (int i = 0; i < 16; i++) {
+            int error = 0;
+            for (int c = 0; c < 4; c++) {
+                int d = palette[i][c] - pixels[t][c];
+                error += d * d;
+            }
+            if (error < best) {
+                best = error;
+                indices[t] = i;
+            }
+        }
+        total += best;
+    }
+    return total;
+}
+
+// Endpoints along the principal axis of the block, then one least squares refit for the chosen indices.
+void encodeBC7Block(const uint8_t pixels[16][4], uint8_t *out) {
+    float mean[4] = {0, 0, 0, 0};
+    for (int t = 0; t < 16; t++) {
+        for (int c = 0; c < 4; c++) {
+            mean[c] += pixels[t][c] / 16.0f;
+        }
+    }
+    float covariance[4][4] = {};
+    for (int t = 0; t < 16; t++) {
+        float d[4];
+        for (int c = 0; c < 4; c++) {
+            d[c] = pixels[t][c] - mean[c];
+        }
+        for (int i = 0; i < 4; i++) {
+            for (int j = 0; j < 4; j++) {
+                covariance[i][j] += d[i] * d[j];
+            }
+        }
+    }
+    float axis[4] = {1, 1, 1, 1};
+    for (int iteration = 0; iteration < 8; iteration++) {
+        float next[4] = {0, 0, 0, 0};
+        for (int i = 0; i < 4; i++) {
+            for (int j = 0; j < 4; j++) {
+                next[i] += covariance[i][j] * axis[j];
+            }
+        }
+        float l = sqrtf(next[0] * next[0] + next[1] * next[1] + next[2] * next[2] + next[3] * next[3]);
+        if (l < 1e-6f) {
+            break;
+        }
+        for (int i = 0; i < 4; i++) {
+            axis[i] = next[i] / l;
+        }
+    }
+    float tmin = 0.0f, tmax = 0.0f;
+    for (int t = 0; t < 16; t++) {
+        float p = 0.0f;
+        for (int c = 0; c < 4; c++) {
+            p += (pixels[t][c] - mean[c]) * axis[c];
+        }
+        tmin = std::min(tmin, p);
+        tmax = std::max(tmax, p);
+    }
+    float e0[4], e1[4];
+    for (int c = 0; c < 4; c++) {
+        e0[c] = std::clamp(mean[c] + axis[c] * tmin, 0.0f, 255.0f);
+        e1[c] = std::clamp(mean[c] + axis[c] * tmax, 0.0f, 255.0f);
+    }
+
+    uint8_t q0[4], q1[4], p0, p1, indices[16];
+    quantizeEndpoint(e0, q0, p0);
+    quantizeEndpoint(e1, q1, p1);
+    float error = findBC7Indices(pixels, q0, p0, q1, p1, indices);
+
+    float aa = 0.0f, ab = 0.0f, bb = 0.0f, ax[4] = {0, 0, 0, 0}, bx[4] = {0, 0, 0, 0};
+    for (int t = 0; t < 16; t++) {
+        float w = kBC7Weights4[indices[t]] / 64.0f;
+        aa += (1.0f - w) * (1.0f - w);
+        ab += (1.0f - w) * w;
+        bb += w * w;
+        for (int c = 0; c < 4; c++) {
+            ax[c] += (1.0f - w) * pixels[t][c];
+            bx[c] += w * pixels[t][c];
+        }
+    }
+    float det = aa * bb - ab * ab;
+    if (fabsf(det) > 1e-6f) {
+        for (int c = 0; c < 4; c++) {
+            e0[c] = std::clamp((ax[c] * bb - bx[c] * ab) / det, 0.0f, 255.0f);
+            e1[c] = std::clamp((bx[c] * aa - ax[c] * ab) / det, 0.0f, 255.0f);
+        }
+        uint8_t r0[4], r1[4], rp0, rp1, refined[16];
+        quantizeEndpoint(e0, r0, rp0);
+        quantizeEndpoint(e1, r1, rp1);
+        if (findBC7Indices(pixels, r0, rp0, r1, rp1, refined) < error) {
+            memcpy(q0, r0, 4), memcpy(q1, r1, 4), memcpy(indices, refined, 16);
+            p0 = rp0, p1 = rp1;
+        }
+    }
+
+    // the anchor index is stored with 3 bits, its top bit has to be zero
+    if (indices[0] & 8) {
+        uint8_t tmp[4];
+        memcpy(tmp, q0, 4), memcpy(q0, q1, 4), memcpy(q1, tmp, 4);
+        std::swap(p0, p1);
+        for (int t = 0; t < 16; t++) {
+            indices[t] = 15 - indices[t];
+        }
+    }
+
+    memset(out, 0, 16);
+    BitWriter w{out};
+    w.write(1 << 6, 7);
+    for (int c = 0; c < 4; c++) {
+        w.write(q0[c], 7);
+        w.write(q1[c], 7);
+    }
+    w.write(p0, 1);
+    w.write(p1, 1);
+    w.write(indices[0], 3);
+    for (int t = 1; t < 16; t++) {
+        w.write(indices[t], 4);
+    }
+}
+
+void decodeBC7Block(const uint8_t *in, uint8_t pixels[16][4]) {
+    BitReader r{in};
+    if (r.read(7) != 1 << 6) {
+        memset(pixels, 0, 64);
+        return;
+    }
+    int e[2][4];
+    for (int c = 0; c < 4; c++) {
+        e[0][c] = r.read(7) << 1;
+        e[1][c] = r.read(7) << 1;
+    }
+    int p0 = r.read(1), p1 = r.read(1);
+    for (int c = 0; c < 4; c++) {
+        e[0][c] |= p0;
+        e[1][c] |= p1;
+    }
+    for (int t = 0; t < 16; t++) {
+        int i = r.read(t == 0 ? 3 : 4);
+        for (int c = 0; c < 4; c++) {
+            pixels[t][c] = ((64 - kBC7Weights4[i]) * e[0][c] + kBC7Weights4[i] * e[1][c] + 32) >> 6;
+        }
+    }
+}
+
+void getBC4Palette(int r0, int r1, int palette[8]) {
+    palette[0] = r0;
+    palette[1] = r1;
+    if (r0 > r1) {
+        for (int i = 1; i < 7; i++) {
+            palette[i + 1] = ((7 - i) * r0 + i * r1 + 3) / 7;
+        }
+    } else {
+        for (int i = 1; i < 5; i++) {
+            palette[i + 1] = ((5 - i) * r0 + i * r1 + 2) / 5;
+        }
+        palette[6] = 0;
+        palette[7] = 255;
+    }
+}
+
+// one channel, stride is the distance between texels in values
+void encodeBC4Block(const uint8_t *values, int stride, uint8_t *out) {
+    int min = 255, max = 0;
+    for (int t = 0; t < 16; t++) {
+        min = std::min(min, (int)values[t * stride]);
+        max = std::max(max, (int)values[t * stride]);
+    }
+    int palette[8];
+    getBC4Palette(max, min, palette);
+    memset(out, 0, 8);
+    out[0] = max;
+    out[1] = min;
+    BitWriter w{out + 2};
+    for (int t = 0; t < 16; t++) {
+        int best = 0;
+        for (int i = 1; i < 8; i++) {
+            if (abs(palette[i] - values[t * stride]) < abs(palette[best] - values[t * stride])) {
+                best = i;
+            }
+        }
+        w.write(best, 3);
+    }
+}
+
+void decodeBC4Block(const uint8_t *in, uint8_t *values, int stride) {
+    int palette[8];
+    getBC4Palette(in[0], in[1], palette);
+    BitReader r{in + 2};
+    for (int t = 0; t < 16; t++) {
+        values[t * stride] = palette[r.read(3)];
+    }
+}
+
+void encodeBlock(const uint8_t pixels[16][4], BlockFormat format, uint8_t *out) {
+    switch (format) {
+        case BlockBC4:
+            encodeBC4Block(&pixels[0][0], 4, out);
+            break;
+        case BlockBC5:
+            encodeBC4Block(&pixels[0][0], 4, out);
+            encodeBC4Block(&pixels[0][1], 4, out + 8);
+            break;
+        default:
+            encodeBC7Block(pixels, out);
+            break;
+    }
+}
+
+void decodeBlock(const uint8_t *in, BlockFormat format, uint8_t pixels[16][4]) {
+    switch (format) {
+        case BlockBC4:
+            decodeBC4Block(in, &pixels[0][0], 4);
+            break;
+        case BlockBC5:
+            decodeBC4Block(in, &pixels[0][0], 4);
+            decodeBC4Block(in + 8, &pixels[0][1], 4);
+            break;
+        default:
+            decodeBC7Block(in, pixels);
+            break;
+    }
+}
+
+void loadBlock(const uint8_t *rgba, int width, int height, int bx, int by, uint8_t pixels[16][4]) {
+    for (int y = 0; y < 4; y++) {
+        for (int x = 0; x < 4; x++) {
+            int sx = std::min(bx * 4 + x, width - 1);
+            int sy = std::min(by * 4 + y, height - 1);
+            memcpy(pixels[y * 4 + x], rgba + (sy * width + sx) * 4, 4);
+        }
+    }
+}
+
+void encodeBlockRows(const uint8_t *rgba, int width, int height, BlockFormat format, int first, int last,
+                     uint8_t *out) {
+    int blocksWide = (width + 3) / 4;
+    int size = getBlockBytes(format);
+    uint8_t pixels[16][4];
+    for (int by = first; by < last; by++) {
+        for (int bx = 0; bx < blocksWide; bx++) {
+            loadBlock(rgba, width, height, bx, by, pixels);
+            encodeBlock(pixels, format, out + (by * blocksWide + bx) * size);
+        }
+    }
+}
+
+size_t getCompressedSize(int width, int height, BlockFormat format) {
+    return (size_t)((width + 3) / 4) * ((height + 3) / 4) * getBlockBytes(format);
+}
+
+// PSNR over the channels the format keeps
+float getBlockPSNR(const uint8_t *rgba, int width, int height, const uint8_t *blocks, BlockFormat format) {
+    int channels = format == BlockBC4 ? 1 : format == BlockBC5 ? 2 : 4;
+    int blocksWide = (width + 3) / 4;
+    double error = 0.0;
+    uint8_t decoded[16][4];
+    for (int by = 0; by < (height + 3) / 4; by++) {
+        for (int bx = 0; bx < blocksWide; bx++) {
+            decodeBlock(blocks + (by * blocksWide + bx) * getBlockBytes(format), format, decoded);
+            for (int t = 0; t < 16; t++) {
+                int x = bx * 4 + t % 4, y = by * 4 + t / 4;
+                if (x >= width || y >= height) {
+                    continue;
+                }
+                for (int c = 0; c < channels; c++) {
+                    double d = decoded[t][c] - rgba[(y * width + x) * 4 + c];
+                    error += d * d;
+                }
+            }
+        }
+    }
+    double mse = error / ((double)width * height * channels);
+    return mse > 0.0 ? 10.0 * log10(255.0 * 255.0 / mse) : 99.0f;
+}
+
+// Compresses every level of every image, split into block rows across the pool. Results are cached on disk under
+// the hash of the source texels, the size, the format and the encoder version.
+void compressImages(ThreadPool &pool, std::vector<Image> &images, const std::vector<TextureRole> &roles) {
+    auto start = std::chrono::steady_clock::now();
+    std::vector<std::future<void>> futures;
+    std::vector<std::pair<size_t, uint64_t>> encoded;
+    double pixels = 0.0;
+    for (size_t i = 0; i < images.size(); i++) {
+        Image &image = images[i];
+        if (image.buffer == nullptr) {
+            continue;
+        }
+        image.format = getBlockFormat(roles[i]);
+        uint64_t key = hashBytes(image.buffer, (size_t)image.width * image.height * 4);
+        key = hashBytes(&image.width, sizeof(int), key);
+        key = hashBytes(&image.height, sizeof(int), key);
+        key = hashBytes(&image.format, sizeof(BlockFormat), key);
+        key = hashBytes(&BC_ENCODER_VERSION, sizeof(BC_ENCODER_VERSION), key);
+
+        int width = image.width, height = image.height;
+        size_t total = 0;
+        for (int level = 0; level < getMipCount(image); level++) {
+            image.compressed.emplace_back(getCompressedSize(width, height, image.format));
+            total += image.compressed.back().size();
+            width = std::max(width / 2, 1);
+            height = std::max(height / 2, 1);
+        }
+        std::vector<unsigned char> cached;
+        if (readCache(key, "bc", cached) && cached.size() == total) {
+            const unsigned char *p = cached.data();
+            for (auto &level : image.compressed) {
+                memcpy(level.data(), p, level.size());
+                p += level.size();
+            }
+            continue;
+        }
+        encoded.emplace_back(i, key);
+
+        width = image.width, height = image.height;
+        for (int level = 0; level < getMipCount(image); level++) {
+            const uint8_t *rgba = level == 0 ? image.buffer : image.mips[level - 1].data();
+            uint8_t *out = image.compressed[level].data();
+            int blocksHigh = (height + 3) / 4;
+            int rows = std::max(1, (int)(16384 / std::max(1, (width + 3) / 4)));
+            for (int first = 0; first < blocksHigh; first += rows) {
+                int last = std::min(first + rows, blocksHigh);
+                BlockFormat format = image.format;
+                futures.push_back(pool.submit([rgba, width, height, format, first, last, out] {
+                    encodeBlockRows(rgba, width, height, format, first, last, out);
+                }));
+            }
+            pixels += (double)width * height;
+            width = std::max(width / 2, 1);
+            height = std::max(height / 2, 1);
+        }
+    }
+    for (auto &f : futures) {
+        f.get();
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    for (auto &[i, key] : encoded) {
+        Image &image = images[i];
+        std::vector<unsigned char> all;
+        for (auto &level : image.compressed) {
+            all.insert(all.end(), level.begin(), level.end());
+        }
+        writeCache(key, "bc", all.data(), all.size());
+        const char *names[] = {"", "BC4", "BC5", "BC7"};
+        std::cout << "image " << i << ": " << names[image.format] << " "
+                  << getBlockPSNR(image.buffer, image.width, image.height, image.compressed[0].data(), image.format)
+                  << " dB" << std::endl;
+    }
+    // the RGBA levels are not uploaded once compressed
+    for (auto &image : images) {
+        if (image.format != BlockNone && image.buffer != nullptr) {
+            free(image.buffer);
+            image.buffer = nullptr;
+            image.mips = {};
+        }
+    }
+    if (!encoded.empty()) {
+        std::cout << "texture compression: " << encoded.size() << " images, " << pixels / seconds / 1e6 << " MP/s"
+                  << std::endl;
+    }
+}
@@ -0,0 +1,161 @@
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Derived data (generated tangents, ...) is kept on disk under a content hash, so the work is done once per asset.
+std::string CACHE_DIR = "cache/";
+
+struct Hash128 {
+    uint64_t h1;
+    uint64_t h2;
+
+    auto operator<=>(const Hash128 &) const = default;
+};
+
+inline uint64_t rotl64(uint64_t x, int r) {
+    return (x << r) | (x >> (64 - r));
+}
+
+inline uint64_t fmix64(uint64_t k) {
+    k ^= k >> 33;
+    k *= 0xff51afd7ed558ccdull;
+    k ^= k >> 33;
+    k *= 0xc4ceb9fe1a85ec53ull;
+    k ^= k >> 33;
+    return k;
+}
+
+// MurmurHash3 x64_128, 16 bytes per step, with a 64 bit seed so hashes can be chained
+Hash128 hash128(const void *data, size_t size, uint64_t seed = 0) {
+    const unsigned char *p = (const unsigned char *)data;
+    const uint64_t c1 = 0x87c37b91114253d5ull;
+    const uint64_t c2 = 0x4cf5ad432745937full;
+    uint64_t h1 = seed, h2 = seed;
+    size_t blocks = size / 16;
+    for (size_t i = 0; i < blocks; i++) {
+        uint64_t k1, k2;
+        memcpy(&k1, p + i * 16, 8);
+        memcpy(&k2, p + i * 16 + 8, 8);
+        k1 *= c1;
+        k1 = rotl64(k1, 31);
+        k1 *= c2;
+        h1 ^= k1;
+        h1 = rotl64(h1, 27);
+        h1 += h2;
+        h1 = h1 * 5 + 0x52dce729;
+        k2 *= c2;
+        k2 = rotl64(k2, 33);
+        k2 *= c1;
+        h2 ^= k2;
+        h2 = rotl64(h2, 31);
+        h2 += h1;
+        h2 = h2 * 5 + 0x38495ab5;
+    }
+
+    const unsigned char *tail = p + blocks * 16;
+    uint64_t k1 = 0, k2 = 0;
+    switch (size & 15) {
+        case 15:
+            k2 ^= (uint64_t)tail[14] << 48;
+            [[fallthrough]];
+        case 14:
+            k2 ^= (uint64_t)tail[13] << 40;
+            [[fallthrough]];
+        case 13:
+            k2 ^= (uint64_t)tail[12] << 32;
+            [[fallthrough]];
+        case 12:
+            k2 ^= (uint64_t)tail[11] << 24;
+            [[fallthrough]];
+        case 11:
+            k2 ^= (uint64_t)tail[10] << 16;
+            [[fallthrough]];
+        case 10:
+            k2 ^= (uint64_t)tail[9] << 8;
+            [[fallthrough]];
+        case 9:
+            k2 ^= (uint64_t)tail[8];
+            k2 *= c2;
+            k2 = rotl64(k2, 33);
+            k2 *= c1;
+            h2 ^= k2;
+            [[fallthrough]];
+        case 8:
+            k1 ^= (uint64_t)tail[7] << 56;
+            [[fallthrough]];
+        case 7:
+            k1 ^= (uint64_t)tail[6] << 48;
+            [[fallthrough]];
+        case 6:
+            k1 ^= (uint64_t)tail[5] << 40;
+            [[fallthrough]];
+        case 5:
+            k1 ^= (uint64_t)tail[4] << 32;
+            [[fallthrough]];
+        case 4:
+            k1 ^= (uint64_t)tail[3] << 24;
+            [[fallthrough]];
+        case 3:
+            k1 ^= (uint64_t)tail[2] << 16;
+            [[fallthrough]];
+        case 2:
+            k1 ^= (uint64_t)tail[1] << 8;
+            [[fallthrough]];
+        case 1:
+            k1 ^= (uint64_t)tail[0];
+            k1 *= c1;
+            k1 = rotl64(k1, 31);
+            k1 *= c2;
+            h1 ^= k1;
+    }
+
+    h1 ^= size;
+    h2 ^= size;
+    h1 += h2;
+    h2 += h1;
+    h1 = fmix64(h1);
+    h2 = fmix64(h2);
+    h1 += h2;
+    h2 += h1;
+    return Hash128{h1, h2};
+}
+
+uint64_t hashBytes(const void *data, size_t size, uint64_t seed = 0) {
+    return hash128(data, size, seed).h1;
+}
+
+std::string getCachePath(uint64_t key, const std::string &kind) {
+    char name[17];
+    snprintf(name, sizeof(name), "%016llx", (unsigned long long)key);
+    return CACHE_DIR + name + "." + kind;
+}
+
+bool readCache(uint64_t key, const std::string &kind, std::vector<unsigned char> &out) {
+    std::ifstream input(getCachePath(key, kind), std::ios::binary);
+    if (!input) {
+        return false;
+    }
+    out = std::vector<unsigned char>(std::istreambuf_iterator<char>(input), {});
+    return true;
+}
+
+// written to a temporary name first, so a concurrent reader never sees half a file
+void writeCache(uint64_t key, const std::string &kind, const void *data, size_t size) {
+    std::error_code error;
+    std::filesystem::create_directories(CACHE_DIR, error);
+    std::string path = getCachePath(key, kind);
+    std::string tmp = path + ".tmp" + std::to_string(std::hash<std::thread::id>()(std::this_thread::get_id()));
+    {
+        std::ofstream output(tmp, std::ios::binary);
+        output.write((const char *)data, size);
+        if (!output) {
+            return;
+        }
+    }
+    std::filesystem::rename(tmp, path, error);
+}
@@ -0,0 +1,173 @@
+#include <chrono>
+#include <cstring>
+#include <future>
+#include <iostream>
+#include <map>
+#include <tuple>
+#include <vector>
+
+// An occlusion and a metallicRoughness image merged into one ORM image: occlusion in red, roughness in green and
+// metallic in blue, the layout glTF already gives the two.
+struct OrmPack {
+    int occlusion; // images
+    int metallicRoughness;
+};
+
+bool isKtx2Image(json &data, int image) {
+    json &i = data["images"][image];
+    std::string uri = i.value("uri", "");
+    return i.value("mimeType", "") == "image/ktx2" ||
+           (uri.size() >= 5 && uri.compare(uri.size() - 5, 5, ".ktx2") == 0);
+}
+
+// Points materials sampling separate occlusion and metallicRoughness images at one packed texture, so the fragment
+// shader fetches once. Packed textures are appended to sources and samplers, their images follow the glTF ones and
+// are built by packOrm. KTX2 images and textures sampled or transformed differently are left alone.
+std::vector<OrmPack> planOrmPacks(json &data,
+                                  std::vector<Mesh> &meshes,
+                                  std::vector<int> &sources,
+                                  std::vector<SamplerKey> &samplers) {
+    size_t count = data["images"].size();
+    std::vector<OrmPack> r;
+    std::map<std::tuple<int, int, SamplerKey>, int> packed;
+    auto getSource = [&](int texture) {
+        return texture >= 0 && texture < (int)sources.size() ? sources[texture] : -1;
+    };
+    for (auto &mesh : meshes) {
+        Material *m = mesh.material;
+        int o = getSource(m->occlusionTexture);
+        int p = getSource(m->metallicRoughnessTexture);
+        if (o < 0 || p < 0 || m->occlusionTexture == m->metallicRoughnessTexture ||
+            samplers[m->occlusionTexture] != samplers[m->metallicRoughnessTexture] ||
+            memcmp(m->uvTransform[SlotOcclusion], m->uvTransform[SlotMetallicRoughness], sizeof(m->uvTransform[0]))) {
+            continue;
+        }
+        if (o == p) {
+            m->occlusionTexture = m->metallicRoughnessTexture;
+            continue;
+        }
+        if (isKtx2Image(data, o) || isKtx2Image(data, p)) {
+            continue;
+        }
+        std::tuple<int, int, SamplerKey> key{o, p, samplers[m->metallicRoughnessTexture]};
+        if (!packed.contains(key)) {
+            r.push_back(OrmPack{o, p});
+            sources.push_back(count + r.size() - 1);
+            samplers.push_back(std::get<2>(key));
+            packed[key] = sources.size() - 1;
+        }
+        m->occlusionTexture = m->metallicRoughnessTexture = packed[key];
+    }
+    if (!r.empty()) {
+        std::cout << "orm: " << r.size() << " packed textures" << std::endl;
+    }
+    return r;
+}
+
+// images some drawn material samples
+std::vector<bool> getUsedImages(std::vector<Mesh> &meshes, std::vector<int> &sources, size_t count) {
+    std::vector<bool> r(count, false);
+    for (auto &mesh : meshes) {
+        Material *m = mesh.material;
+        for (int texture : {m->baseColorTexture,
+                            m->metallicRoughnessTexture,
+                            m->normalTexture,
+                            m->emissiveTexture,
+                            m->occlusionTexture}) {
+            if (texture >= 0 && texture < (int)sources.size() && sources[texture] >= 0 &&
+                sources[texture] < (int)count) {
+                r[sources[texture]] = true;
+            }
+        }
+    }
+    return r;
+}
+
+// Builds the packed images on the pool, occlusion is resampled (nearest) when its size differs. Images no material
+// samples any more are freed.
+void packOrm(ThreadPool &pool, std::vector<Image> &images, const std::vector<OrmPack> &packs,
+             const std::vector<bool> &used) {
+    size_t count = images.size();
+    images.resize(count + packs.size(), Image(0, 0, 0, nullptr));
+    std::vector<std::future<void>> futures;
+    for (size_t i = 0; i < packs.size(); i++) {
+        const Image &o = images[packs[i].occlusion];
+        const Image &p = images[packs[i].metallicRoughness];
+        if (o.buffer == nullptr || p.buffer == nullptr) {
+            continue;
+        }
+        Image *out = &images[count + i];
+        futures.push_back(pool.submit([&o, &p, out] {
+            *out = Image(p.width, p.height, 4, (unsigned char *)malloc((size_t)p.width * p.height * 4));
+            memcpy(out->buffer, p.buffer, (size_t)p.width * p.height * 4);
+            for (int y = 0; y < p.height; y++) {
+                int oy = (int)((int64_t)y * o.height / p.height);
+                for (int x = 0; x < p.width; x++) {
+                    int ox = (int)((int64_t)x * o.width / p.width);
+                    out->buffer[((size_t)y * p.width + x) * 4] = o.buffer[((size_t)oy * o.width + ox) * 4];
+                }
+            }
+        }));
+    }
+    for (auto &f : futures) {
+        f.get();
+    }
+    for (size_t i = 0; i < images.size(); i++) {
+        if (i < used.size() && !used[i] && images[i].buffer != nullptr) {
+            free(images[i].buffer);
+            images[i] = Image(0, 0, 0, nullptr);
+        }
+    }
+}
+
+// Occlusion maps keep their red channel (R8) and normal maps red and green (RG8) when they stay uncompressed.
+void reduceChannels(ThreadPool &pool, std::vector<Image> &images, const std::vector<TextureRole> &roles) {
+    auto start = std::chrono::steady_clock::now();
+    size_t before = 0, after = 0;
+    std::vector<std::future<void>> futures;
+    for (size_t i = 0; i < images.size(); i++) {
+        Image &image = images[i];
+        int channels = roles[i] == TextureOcclusion ? 1 : roles[i] == TextureNormal ? 2 : 4;
+        if (image.buffer == nullptr || image.format != BlockNone || image.channels != 4 || channels == 4) {
+            continue;
+        }
+        int width = image.width, height = image.height;
+        for (int level = 0; level < getMipCount(image); level++) {
+            unsigned char *pixels = level == 0 ? image.buffer : image.mips[level - 1].data();
+            size_t texels = (size_t)width * height;
+            futures.push_back(pool.submit([pixels, texels, channels] {
+                for (size_t t = 0; t < texels; t++) {
+                    for (int c = 0; c < channels; c++) {
+                        pixels[t * channels + c] = pixels[t * 4 + c];
+                    }
+                }
+            }));
+            before += texels * 4;
+            after += texels * channels;
+            width = std::max(width / 2, 1);
+            height = std::max(height / 2, 1);
+        }
+        image.channels = channels;
+    }
+    for (auto &f : futures) {
+        f.get();
+    }
+    // the texels were compacted in place, the tails are dropped
+    for (auto &image : images) {
+        if (image.buffer == nullptr || image.format != BlockNone || image.channels == 4) {
+            continue;
+        }
+        image.buffer = (unsigned char *)realloc(image.buffer, (size_t)image.width * image.height * image.channels);
+        for (size_t level = 0; level < image.mips.size(); level++) {
+            int width = std::max(image.width >> (level + 1), 1);
+            int height = std::max(image.height >> (level + 1), 1);
+            image.mips[level].resize((size_t)width * height * image.channels);
+            image.mips[level].shrink_to_fit();
+        }
+    }
+    if (before > 0) {
+        auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start);
+        std::cout << "channels: " << (before >> 10) << " KB to " << (after >> 10) << " KB in " << ms.count() << " ms"
+                  << std::endl;
+    }
+}
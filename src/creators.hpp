@@ -1,5 +1,7 @@
 #include <math.h>
 #include <array>
+#include <chrono>
+#include <cstring>
 #include <fstream>
 #include <iostream>
 #include <json/json.hpp>
@@ -8,12 +10,31 @@
 #include <tuple>
 using json = nlohmann::json;
 
-#define STB_IMAGE_IMPLEMENTATION
-#include "image/stb_image.h"
-
 std::string MODEL_NAME = "StainedGlassLamp";
 std::string BASE_URL =
     "https://raw.githubusercontent.com/KhronosGroup/glTF-Sample-Assets/main/Models/" + MODEL_NAME + "/glTF/";
+// upload interleaved 16 bit vertices (see quantize.hpp) instead of float attribute streams
+bool QUANTIZE_VERTICES = false;
+// merge vertices whose attributes are equal within WELD_EPSILON (see weld.hpp)
+bool WELD_VERTICES = false;
+float WELD_EPSILON = 1e-5f;
+// simplify large primitives into a LOD chain, picked per frame by projected error in pixels (see simplify.hpp)
+bool BUILD_LODS = false;
+float LOD_PIXEL_ERROR = 1.0f;
+// BC7 / BC5 / BC4 compress textures on the CPU when the device supports them (see bc.hpp)
+bool COMPRESS_TEXTURES = true;
+// merge static primitives sharing a material into one pre-transformed draw (see batch.hpp)
+bool BATCH_STATIC = false;
+// split primitives into meshlets and draw only the ones inside the frustum (see meshlets.hpp)
+bool BUILD_MESHLETS = false;
+// render with placeholders while images load, then stream mips in within a per frame upload budget (see streamer.hpp)
+bool STREAM_TEXTURES = true;
+size_t STREAM_BUDGET = 8 << 20;
+// resident texture memory, least recently drawn textures drop their top levels (GPU) or move to the cache (CPU)
+size_t TEXTURE_GPU_BUDGET = 512 << 20;
+size_t TEXTURE_CPU_BUDGET = 256 << 20;
+// anisotropic filtering for linear mipmapped samplers (see samplers.hpp)
+int MAX_ANISOTROPY = 8;
 
 json getEntry() {
     json data;
@@ -28,22 +49,126 @@ json getEntry() {
     return data;
 }
 
-std::vector<unsigned char> getBuffer(json &data) {
-    std::string u = data["buffers"][0]["uri"];
-    int l = data["buffers"][0]["byteLength"];
-    std::vector<unsigned char> buffer;
+std::vector<char> loadBuffer(std::string u) {
     if (true) {
-        std::string url2 = BASE_URL + u;
-        std::string str = *request(url2);
-        buffer = std::vector<unsigned char>(str.begin(), str.end());
-    } else {
-        std::ifstream input("../models/" + u, std::ios::binary);
-        buffer = std::vector<unsigned char>(std::istreambuf_iterator<char>(input), {});
+        return download(BASE_URL + u);
+    }
+    std::ifstream input("../models/" + u, std::ios::binary);
+    return std::vector<char>(std::istreambuf_iterator<char>(input), {});
+}
+
+// All buffers are fetched in parallel and concatenated (4 byte aligned) into one, every bufferView is rebased onto
+// it. EXT_meshopt_compression views are decoded on the pool into their place as soon as the buffer holding the
+// compressed data arrives, in whatever order the fetches complete. Buffers that only receive decoded views, fallback
+// buffers and buffers the scene does not use are never downloaded.
+std::vector<unsigned char> getBuffer(ThreadPool &pool, json &data, const Reachable &reachable) {
+    struct Decode {
+        MeshoptView view;
+        size_t src; // offset in the compressed data's buffer
+        size_t out; // offset in the concatenated buffer
+    };
+    std::vector<size_t> base;
+    size_t length = 0;
+    for (auto &b : data["buffers"]) {
+        base.push_back(length);
+        length += ((size_t)b["byteLength"] + 3) & ~size_t(3);
+    }
+    std::vector<std::vector<Decode>> decodes(base.size());
+    std::vector<bool> targets(base.size(), false);
+    for (size_t v = 0; v < data["bufferViews"].size(); v++) {
+        json &view = data["bufferViews"][v];
+        if (!reachable.bufferViews[v] || !view.contains("extensions") ||
+            !view["extensions"].contains("EXT_meshopt_compression")) {
+            continue;
+        }
+        json &meshopt = view["extensions"]["EXT_meshopt_compression"];
+        int target = view["buffer"];
+        targets[target] = true;
+        decodes[(int)meshopt["buffer"]].push_back(Decode{
+            getMeshoptView(meshopt), meshopt.value("byteOffset", (size_t)0), base[target] + view.value("byteOffset", 0)});
     }
 
+    std::vector<unsigned char> buffer(length, 0);
+    std::vector<std::future<std::vector<std::future<bool>>>> futures;
+    for (size_t i = 0; i < base.size(); i++) {
+        json &b = data["buffers"][i];
+        bool fallback = b.contains("extensions") && b["extensions"].contains("EXT_meshopt_compression") &&
+                        b["extensions"]["EXT_meshopt_compression"].value("fallback", false);
+        if (fallback || (targets[i] && decodes[i].empty()) || !b.contains("uri") || !reachable.buffers[i]) {
+            continue;
+        }
+        size_t byteLength = b["byteLength"];
+        unsigned char *dst = buffer.data() + base[i];
+        futures.push_back(std::async(
+            std::launch::async, [&pool, &buffer, &decodes = decodes[i], uri = (std::string)b["uri"], byteLength, dst] {
+                std::vector<char> res = loadBuffer(uri);
+                memcpy(dst, res.data(), std::min(res.size(), byteLength));
+                std::vector<std::future<bool>> r;
+                for (const Decode &d : decodes) {
+                    const unsigned char *src = dst + d.src;
+                    unsigned char *out = buffer.data() + d.out;
+                    r.push_back(pool.submit([&d, src, out] { return decodeMeshoptView(d.view, src, out); }));
+                }
+                return r;
+            }));
+    }
+    for (auto &f : futures) {
+        for (auto &decode : f.get()) {
+            decode.get();
+        }
+    }
+
+    for (auto &view : data["bufferViews"]) {
+        view["byteOffset"] = view.value("byteOffset", 0) + base[(int)view["buffer"]];
+        view["buffer"] = 0;
+    }
     return buffer;
 }
 
+// KHR_texture_transform of a textureInfo as translation * rotation * scale, the per fragment trig is done here once
+void readUvTransform(json &info, Material *m, TextureSlot slot) {
+    if (!info.contains("extensions") || !info["extensions"].contains("KHR_texture_transform")) {
+        return;
+    }
+    json &t = info["extensions"]["KHR_texture_transform"];
+    std::vector<float> offset = t.value("offset", std::vector<float>{0.0f, 0.0f});
+    std::vector<float> scale = t.value("scale", std::vector<float>{1.0f, 1.0f});
+    float rotation = t.value("rotation", 0.0f);
+    float c = cosf(rotation), s = sinf(rotation);
+    float rows[2][4] = {{c * scale[0], s * scale[1], offset[0], 0.0f}, {-s * scale[0], c * scale[1], offset[1], 0.0f}};
+    memcpy(m->uvTransform[slot], rows, sizeof(rows));
+}
+
+// a transform shared by every sampled texture moves to the vertex stage
+UvTransformStage getUvTransformStage(Material *m) {
+    int textures[5] = {m->baseColorTexture,
+                       m->normalTexture,
+                       m->metallicRoughnessTexture,
+                       m->emissiveTexture,
+                       m->occlusionTexture};
+    const Material identity{};
+    int first = -1;
+    bool shared = true, transformed = false;
+    for (int slot = 0; slot < 5; slot++) {
+        if (textures[slot] < 0) {
+            continue;
+        }
+        if (first == -1) {
+            first = slot;
+        }
+        shared &= memcmp(m->uvTransform[slot], m->uvTransform[first], sizeof(m->uvTransform[slot])) == 0;
+        transformed |= memcmp(m->uvTransform[slot], identity.uvTransform[slot], sizeof(m->uvTransform[slot])) != 0;
+    }
+    if (!transformed) {
+        return UvTransformNone;
+    }
+    if (!shared) {
+        return UvTransformFragment;
+    }
+    memcpy(m->uvTransform[0], m->uvTransform[first], sizeof(m->uvTransform[0]));
+    return UvTransformVertex;
+}
+
 void buildMesh(json &data, std::vector<Mesh> &meshes, std::vector<Buffer> &geometries) {
     for (auto &mesh : data["meshes"]) {
         auto primitive = mesh["primitives"][0];
@@ -66,27 +191,38 @@ void buildMesh(json &data, std::vector<Mesh> &meshes, std::vector<Buffer> &geome
         m->metallicFactor = pbr.value("metallicFactor", 1);
         if (pbr.contains("baseColorTexture")) {
             m->baseColorTexture = pbr["baseColorTexture"]["index"];
+            readUvTransform(pbr["baseColorTexture"], m, SlotBaseColor);
+        }
+        if (pbr.contains("metallicRoughnessTexture")) {
+            m->metallicRoughnessTexture = pbr["metallicRoughnessTexture"]["index"];
+            readUvTransform(pbr["metallicRoughnessTexture"], m, SlotMetallicRoughness);
         }
         if (material.contains("emissiveTexture")) {
             m->emissiveTexture = material["emissiveTexture"]["index"];
+            readUvTransform(material["emissiveTexture"], m, SlotEmissive);
         }
         if (material.contains("occlusionTexture")) {
             m->occlusionTexture = material["occlusionTexture"]["index"];
+            readUvTransform(material["occlusionTexture"], m, SlotOcclusion);
         }
         if (material.contains("normalTexture")) {
             m->normalTexture = material["normalTexture"]["index"];
+            readUvTransform(material["normalTexture"], m, SlotNormal);
         }
+        m->uvTransformStage = getUvTransformStage(m);
 
         meshes.push_back(Mesh{g, m});
+        meshes.back().materialIndex = i;
+        meshes.back().meshIndex = meshes.size() - 1;
     }
 }
 
-void buildNode(json &data, std::vector<glm::mat4> &matricies, glm::vec3 &center) {
+void buildNode(json &data, std::vector<glm::mat4> &matricies) {
     for (auto &n : data["nodes"]) {
         std::queue<json> queue;
 
         queue.push(n);
-        glm::mat4 root = glm::translate(glm::mat4(1.0f), -center);
+        glm::mat4 root = glm::mat4(1.0f);
 
         while (!queue.empty()) {
             nlohmann::json node = queue.front();
@@ -124,22 +260,25 @@ void buildNode(json &data, std::vector<glm::mat4> &matricies, glm::vec3 &center)
     }
 }
 
-std::tuple<glm::vec3, float> buildGeometry(json &data, std::vector<unsigned char> &buffer, std::vector<Buffer> &geometries) {
-    glm::vec3 mMax{-INFINITY, -INFINITY, -INFINITY};
-    glm::vec3 mMin{INFINITY, INFINITY, INFINITY};
-
+void buildGeometry(json &data, std::vector<unsigned char> &buffer, std::vector<Buffer> &geometries) {
     for (auto &accessor : data["accessors"]) {
-        int v = accessor["bufferView"];
-        auto bufferView = data["bufferViews"][v];
-
-        int offset1 = bufferView.value("byteOffset", 0);
-        int offset2 = accessor.value("byteOffset", 0);
-        int stride = bufferView.value("byteStride", 0);
-        int offset = offset1 + offset2;
-        int length = (int)bufferView["byteLength"] - offset2;
-
         int count = accessor["count"];
         int sizeofComponent = getCount(accessor["componentType"]);
+
+        // no bufferView means zeros, materialized together with the sparse values on first use
+        int offset = -1;
+        int length = count * sizeofComponent * getDataType(accessor["type"]);
+        int stride = 0;
+        if (accessor.contains("bufferView")) {
+            int v = accessor["bufferView"];
+            auto bufferView = data["bufferViews"][v];
+
+            int offset1 = bufferView.value("byteOffset", 0);
+            int offset2 = accessor.value("byteOffset", 0);
+            stride = bufferView.value("byteStride", 0);
+            offset = offset1 + offset2;
+            length = (int)bufferView["byteLength"] - offset2;
+        }
         int strideValue = 0;
         // int typeofComponent = getDataType(accessor["type"]);
         // int lengthByStride = (stride * count) / sizeofComponent;
@@ -165,39 +304,139 @@ std::tuple<glm::vec3, float> buildGeometry(json &data, std::vector<unsigned char
         //     }
         // }
 
-        if (accessor.contains("min") && accessor.contains("max") && accessor["type"] == "VEC3") {
-            glm::vec3 min = glm::vec3(accessor["min"][0], accessor["min"][1], accessor["min"][2]);
-            glm::vec3 max = glm::vec3(accessor["max"][0], accessor["max"][1], accessor["max"][2]);
-            mMin = glm::min(min, mMin);
-            mMax = glm::max(max, mMax);
+        Buffer g{offset, length, count, sizeofComponent, strideValue}; //* getCount(accessor["componentType"])});
+        g.componentType = accessor["componentType"];
+        g.components = getDataType(accessor["type"]);
+        g.byteStride = stride;
+        g.normalized = accessor.value("normalized", false);
+        if (accessor.contains("sparse")) {
+            json sparse = accessor["sparse"];
+            json indices = sparse["indices"];
+            json values = sparse["values"];
+            g.sparse.count = sparse["count"];
+            g.sparse.indicesOffset = data["bufferViews"][(int)indices["bufferView"]].value("byteOffset", 0) +
+                                     indices.value("byteOffset", 0);
+            g.sparse.indicesComponentType = indices["componentType"];
+            g.sparse.valuesOffset = data["bufferViews"][(int)values["bufferView"]].value("byteOffset", 0) +
+                                    values.value("byteOffset", 0);
         }
+        geometries.push_back(std::move(g));
+    }
+}
 
-        geometries.push_back(Buffer{offset, length, count, sizeofComponent, strideValue}); //* getCount(accessor["componentType"])});
+// accessor min/max hold the stored values, normalized accessors still have to be scaled
+glm::vec3 getBound(json &accessor, const char *name) {
+    float scale = 1.0f;
+    if (accessor.value("normalized", false)) {
+        switch ((int)accessor["componentType"]) {
+            case 5120:
+                scale = 1.0f / 127.0f;
+                break;
+            case 5121:
+                scale = 1.0f / 255.0f;
+                break;
+            case 5122:
+                scale = 1.0f / 32767.0f;
+                break;
+            case 5123:
+                scale = 1.0f / 65535.0f;
+                break;
+        }
+    }
+    json v = accessor[name];
+    return glm::vec3(v[0], v[1], v[2]) * scale;
+}
+
+// Bounds of the POSITION data moved through the node matrices, so quantized positions whose dequantization
+// lives in the node transform (KHR_mesh_quantization) end up in the right place. Centers the model.
+// Scene bounds from the meshes the scene shows, inactive scenes and variants do not move the camera.
+std::tuple<glm::vec3, float> buildBounds(json &data,
+                                         std::vector<glm::mat4> &matricies,
+                                         const std::vector<bool> &reachable) {
+    glm::vec3 mMax{-INFINITY, -INFINITY, -INFINITY};
+    glm::vec3 mMin{INFINITY, INFINITY, INFINITY};
+
+    for (size_t i = 0; i < data["meshes"].size() && i < matricies.size(); i++) {
+        if (i < reachable.size() && !reachable[i]) {
+            continue;
+        }
+        int pos = data["meshes"][i]["primitives"][0]["attributes"]["POSITION"];
+        json accessor = data["accessors"][pos];
+        if (!accessor.contains("min") || !accessor.contains("max")) {
+            continue;
+        }
+        glm::vec3 min = getBound(accessor, "min");
+        glm::vec3 max = getBound(accessor, "max");
+        for (int k = 0; k < 8; k++) {
+            glm::vec3 corner(k & 1 ? max.x : min.x, k & 2 ? max.y : min.y, k & 4 ? max.z : min.z);
+            glm::vec4 p = matricies[i] * glm::vec4(corner, 1.0f);
+            mMin = glm::min(glm::vec3(p.x, p.y, p.z), mMin);
+            mMax = glm::max(glm::vec3(p.x, p.y, p.z), mMax);
+        }
     }
 
     glm::vec3 vec = mMax - mMin;
     glm::vec3 center = (mMax + mMin) * 0.5f;
+    for (auto &m : matricies) {
+        m = glm::translate(glm::mat4(1.0f), -center) * m;
+    }
     return std::make_tuple(center, glm::length(vec));
 }
 
-std::vector<Image> buildImages(json &data) {
-    std::vector<std::future<std::vector<char>>> futures;
-    std::vector<Image> images;
-    for (auto &image : data["images"]) {
+Image decodeImage(const std::vector<char> &res) {
+    if (isKtx2(res)) {
+        return loadKtx2(res);
+    }
+    Image image(0, 0, 0, nullptr);
+    decodeWith(res, image);
+    return image;
+}
+
+// Every download hands its bytes to the pool as soon as it completes, so images decode in parallel and in
+// completion order. Workers write straight into their preallocated slot; images the scene does not use stay empty
+// placeholders, so indices keep matching the glTF. Images that decode cheaply at 1/8 (JPEG) first go to previews.
+std::vector<Image> buildImages(ThreadPool &pool,
+                               json &data,
+                               const std::vector<bool> &reachable,
+                               PreviewQueue *previews = nullptr) {
+    auto start = std::chrono::steady_clock::now();
+    std::vector<Image> images(data["images"].size(), Image(0, 0, 0, nullptr));
+    std::vector<std::future<std::future<double>>> futures;
+    for (size_t i = 0; i < images.size(); i++) {
+        json &image = data["images"][i];
+        if (!reachable[i] || !image.contains("uri")) {
+            continue;
+        }
         std::string url = image["uri"];
         std::string url2 = BASE_URL + url;
-        futures.push_back(std::async(std::launch::async, &download, url2));
+        Image *slot = &images[i];
+        futures.push_back(std::async(std::launch::async, [&pool, url2, slot, previews, i] {
+            std::vector<char> res = download(url2);
+            return pool.submit([res = std::move(res), slot, previews, i] {
+                Image preview(0, 0, 0, nullptr);
+                if (previews && decodePreview(res, preview)) {
+                    std::lock_guard<std::mutex> lock(previews->mutex);
+                    previews->images.emplace_back(i, preview);
+                }
+                auto start = std::chrono::steady_clock::now();
+                *slot = decodeImage(res);
+                return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+            });
+        }));
     }
-    for (size_t i = 0; i < futures.size(); ++i) {
-       std::vector<char> res = futures[i].get();
-
-        int width, height, nrChannels;
-        unsigned char *buffer;
-        buffer = stbi_load_from_memory((unsigned char *)res.data(), res.size(), &width, &height, &nrChannels, 4);
-        // std::string url2 = "../models/" + url;
-        // buffer = stbi_load(url2.data(), &width, &height, &nrChannels, 4);
-        // std::cout << "unable to load image: " << stbi_failure_reason() << std::endl;
-        images.push_back(Image(width, height, nrChannels, buffer));
+    std::vector<std::future<double>> decodes;
+    for (auto &f : futures) {
+        decodes.push_back(f.get());
+    }
+    for (size_t i = 0, k = 0; i < images.size(); i++) {
+        if (!reachable[i] || !data["images"][i].contains("uri")) {
+            continue;
+        }
+        double ms = decodes[k++].get();
+        std::cout << "image " << i << ": " << images[i].width << "x" << images[i].height << " decoded in " << ms
+                  << " ms" << std::endl;
     }
+    auto total = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    std::cout << "images: " << decodes.size() << " loaded in " << total << " ms" << std::endl;
     return images;
 }
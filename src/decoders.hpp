@@ -0,0 +1,328 @@
+#include <chrono>
+#include <csetjmp>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <vector>
+
+#define STB_IMAGE_IMPLEMENTATION
+#include "image/stb_image.h"
+
+#ifdef REDCUBE_PNG
+#include <png.h>
+#endif
+#ifdef REDCUBE_SPNG
+#include <spng.h>
+#endif
+#ifdef REDCUBE_JPEG
+#include <cstdio>
+#include <jpeglib.h>
+#endif
+
+// Decodes encoded images to RGBA8. scale (1, 2, 4 or 8) asks for a downscaled decode where the format allows it
+// cheaply, e.g. JPEG DCT scaling for a preview or a low mip; decoders that cannot scale return the full size and say
+// so with scales(). The png and jpeg decoders write into one allocation of the final size, made once the header is
+// read.
+class ImageDecoder {
+public:
+    virtual ~ImageDecoder() = default;
+    virtual const char *name() const = 0;
+    virtual bool scales() const {
+        return false;
+    }
+    virtual bool accepts(const std::vector<char> &res) const = 0;
+    virtual bool decode(const std::vector<char> &res, Image &out, int scale = 1) const = 0;
+};
+
+bool isPng(const std::vector<char> &res) {
+    return res.size() >= 8 && memcmp(res.data(), "\x89PNG\r\n\x1a\n", 8) == 0;
+}
+
+bool isJpeg(const std::vector<char> &res) {
+    return res.size() >= 3 && (unsigned char)res[0] == 0xFF && (unsigned char)res[1] == 0xD8 &&
+           (unsigned char)res[2] == 0xFF;
+}
+
+// every format stb_image knows, with its own decode buffer and a channel conversion copy
+class StbDecoder : public ImageDecoder {
+public:
+    const char *name() const override {
+        return "stb";
+    }
+    // only parses the header
+    bool accepts(const std::vector<char> &res) const override {
+        int width, height, channels;
+        return stbi_info_from_memory((const unsigned char *)res.data(), res.size(), &width, &height, &channels);
+    }
+    bool decode(const std::vector<char> &res, Image &out, int scale) const override {
+        int width, height, nrChannels;
+        unsigned char *buffer =
+            stbi_load_from_memory((unsigned char *)res.data(), res.size(), &width, &height, &nrChannels, 4);
+        if (buffer == nullptr) {
+            std::cout << "unable to load image: " << stbi_failure_reason() << std::endl;
+            return false;
+        }
+        out = Image(width, height, 4, buffer);
+        return true;
+    }
+};
+
+#ifdef REDCUBE_PNG
+// libpng's simplified API, 16 bit and palette images are converted while rows are written
+class PngDecoder : public ImageDecoder {
+public:
+    const char *name() const override {
+        return "libpng";
+    }
+    bool accepts(const std::vector<char> &res) const override {
+        return isPng(res);
+    }
+    bool decode(const std::vector<char> &res, Image &out, int scale) const override {
+        png_image png;
+        memset(&png, 0, sizeof(png));
+        png.version = PNG_IMAGE_VERSION;
+        if (!png_image_begin_read_from_memory(&png, res.data(), res.size())) {
+            return false;
+        }
+        png.format = PNG_FORMAT_RGBA;
+        unsigned char *pixels = (unsigned char *)malloc(PNG_IMAGE_SIZE(png));
+        if (pixels == nullptr || !png_image_finish_read(&png, nullptr, pixels, 0, nullptr)) {
+            png_image_free(&png);
+            free(pixels);
+            return false;
+        }
+        out = Image(png.width, png.height, 4, pixels);
+        return true;
+    }
+};
+#endif
+
+#ifdef REDCUBE_SPNG
+// libspng, a faster inflate and unfilter path than libpng's
+class SpngDecoder : public ImageDecoder {
+public:
+    const char *name() const override {
+        return "spng";
+    }
+    bool accepts(const std::vector<char> &res) const override {
+        return isPng(res);
+    }
+    bool decode(const std::vector<char> &res, Image &out, int scale) const override {
+        spng_ctx *ctx = spng_ctx_new(0);
+        spng_ihdr ihdr;
+        size_t size = 0;
+        unsigned char *pixels = nullptr;
+        bool ok = ctx && spng_set_png_buffer(ctx, res.data(), res.size()) == 0 && spng_get_ihdr(ctx, &ihdr) == 0 &&
+                  spng_decoded_image_size(ctx, SPNG_FMT_RGBA8, &size) == 0 &&
+                  (pixels = (unsigned char *)malloc(size)) != nullptr &&
+                  spng_decode_image(ctx, pixels, size, SPNG_FMT_RGBA8, SPNG_DECODE_TRNS) == 0;
+        spng_ctx_free(ctx);
+        if (!ok) {
+            free(pixels);
+            return false;
+        }
+        out = Image(ihdr.width, ihdr.height, 4, pixels);
+        return true;
+    }
+};
+#endif
+
+#ifdef REDCUBE_JPEG
+struct JpegError {
+    jpeg_error_mgr pub;
+    jmp_buf jump;
+};
+
+void exitJpeg(j_common_ptr info) {
+    longjmp(((JpegError *)info->err)->jump, 1);
+}
+
+// libjpeg, SIMD accelerated when it is libjpeg-turbo. Scanlines are read into their final row; without turbo's RGBA
+// output the RGB row is widened in place, from the end so nothing is overwritten before it is read. Scaling is done
+// in the IDCT, which is far cheaper than a full decode.
+class JpegDecoder : public ImageDecoder {
+public:
+    const char *name() const override {
+        return "libjpeg";
+    }
+    bool scales() const override {
+        return true;
+    }
+    bool accepts(const std::vector<char> &res) const override {
+        return isJpeg(res);
+    }
+    bool decode(const std::vector<char> &res, Image &out, int scale) const override {
+        jpeg_decompress_struct info;
+        JpegError error;
+        unsigned char *volatile pixels = nullptr;
+        info.err = jpeg_std_error(&error.pub);
+        error.pub.error_exit = exitJpeg;
+        if (setjmp(error.jump)) {
+            jpeg_destroy_decompress(&info);
+            free(pixels);
+            return false;
+        }
+        jpeg_create_decompress(&info);
+        jpeg_mem_src(&info, (const unsigned char *)res.data(), res.size());
+        jpeg_read_header(&info, TRUE);
+        info.scale_num = 1;
+        info.scale_denom = scale;
+#ifdef JCS_EXTENSIONS
+        info.out_color_space = JCS_EXT_RGBA;
+        const int components = 4;
+#else
+        if (info.jpeg_color_space != JCS_YCbCr && info.jpeg_color_space != JCS_RGB) {
+            jpeg_destroy_decompress(&info);
+            return false;
+        }
+        info.out_color_space = JCS_RGB;
+        const int components = 3;
+#endif
+        jpeg_start_decompress(&info);
+        if ((int)info.output_components != components) {
+            jpeg_destroy_decompress(&info);
+            return false;
+        }
+        size_t stride = (size_t)info.output_width * 4;
+        pixels = (unsigned char *)malloc(stride * info.output_height);
+        if (pixels == nullptr) {
+            jpeg_destroy_decompress(&info);
+            return false;
+        }
+        while (info.output_scanline < info.output_height) {
+            unsigned char *row = pixels + info.output_scanline * stride;
+            jpeg_read_scanlines(&info, &row, 1);
+            if (components == 3) {
+                for (int x = info.output_width - 1; x >= 0; x--) {
+                    row[x * 4 + 3] = 255;
+                    row[x * 4 + 2] = row[x * 3 + 2];
+                    row[x * 4 + 1] = row[x * 3 + 1];
+                    row[x * 4] = row[x * 3];
+                }
+            }
+        }
+        jpeg_finish_decompress(&info);
+        out = Image(info.output_width, info.output_height, 4, pixels);
+        jpeg_destroy_decompress(&info);
+        return true;
+    }
+};
+#endif
+
+// in order of preference, stb last since it takes every format it knows
+const std::vector<std::unique_ptr<ImageDecoder>> &getDecoders() {
+    static std::vector<std::unique_ptr<ImageDecoder>> decoders = [] {
+        std::vector<std::unique_ptr<ImageDecoder>> r;
+#ifdef REDCUBE_SPNG
+        r.push_back(std::make_unique<SpngDecoder>());
+#endif
+#ifdef REDCUBE_PNG
+        r.push_back(std::make_unique<PngDecoder>());
+#endif
+#ifdef REDCUBE_JPEG
+        r.push_back(std::make_unique<JpegDecoder>());
+#endif
+        r.push_back(std::make_unique<StbDecoder>());
+        return r;
+    }();
+    return decoders;
+}
+
+bool decodeWith(const std::vector<char> &res, Image &out, int scale = 1) {
+    bool accepted = false;
+    for (auto &decoder : getDecoders()) {
+        if (decoder->accepts(res)) {
+            accepted = true;
+            if (decoder->decode(res, out, scale)) {
+                return true;
+            }
+        }
+    }
+    if (!accepted) {
+        std::cout << "unable to load image: unknown format" << std::endl;
+    }
+    return false;
+}
+
+// A 1/8 size decode, a fraction of the cost of the full one, for formats a decoder can scale (JPEG); false when none
+// can, a full size decode would be no preview.
+bool decodePreview(const std::vector<char> &res, Image &out) {
+    for (auto &decoder : getDecoders()) {
+        if (decoder->scales() && decoder->accepts(res)) {
+            return decoder->decode(res, out, 8);
+        }
+    }
+    return false;
+}
+
+// Decodes every file of dir with every decoder that accepts it, and prints the encoded MB/s and decoded MP/s of each.
+// Decoders that scale are also measured at 1/8. Files no decoder recognises are skipped.
+int benchDecoders(const char *dir) {
+    struct Result {
+        int files = 0;
+        double bytes = 0.0;
+        double pixels = 0.0;
+        double seconds = 0.0;
+    };
+    std::map<std::string, Result> results;
+    std::error_code error;
+    for (auto &entry : std::filesystem::directory_iterator(dir, error)) {
+        if (!entry.is_regular_file()) {
+            continue;
+        }
+        std::ifstream input(entry.path(), std::ios::binary);
+        std::vector<char> res(std::istreambuf_iterator<char>(input), {});
+        for (auto &decoder : getDecoders()) {
+            if (!decoder->accepts(res)) {
+                continue;
+            }
+            int fullWidth = 0;
+            for (int scale : {1, 8}) {
+                if (scale != 1 && !decoder->scales()) {
+                    continue;
+                }
+                int runs = 0, width = 0;
+                double pixels = 0.0, seconds = 0.0;
+                auto start = std::chrono::steady_clock::now();
+                // at least three runs and a quarter second per file
+                do {
+                    Image image(0, 0, 0, nullptr);
+                    if (!decoder->decode(res, image, scale)) {
+                        break;
+                    }
+                    width = image.width;
+                    pixels = (double)image.width * image.height;
+                    free(image.buffer);
+                    runs++;
+                    seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+                } while (runs < 3 || seconds < 0.25);
+                if (scale == 1) {
+                    fullWidth = width;
+                }
+                // decoders that ignore scale are only reported at full size
+                if (runs == 0 || (scale != 1 && width >= fullWidth)) {
+                    continue;
+                }
+                std::string name = decoder->name() + (scale == 1 ? std::string() : " 1/" + std::to_string(scale));
+                Result &r = results[name];
+                r.files++;
+                r.bytes += (double)res.size() * runs;
+                r.pixels += pixels * runs;
+                r.seconds += seconds;
+            }
+        }
+    }
+    if (results.empty()) {
+        std::cout << "no decodable images in " << dir << std::endl;
+        return 1;
+    }
+    for (auto &[name, r] : results) {
+        std::cout << name << ": " << r.files << " files, " << r.bytes / r.seconds / 1e6 << " MB/s, "
+                  << r.pixels / r.seconds / 1e6 << " MP/s" << std::endl;
+    }
+    return 0;
+}
@@ -0,0 +1,53 @@
+#include <chrono>
+#include <future>
+#include <iostream>
+#include <map>
+#include <vector>
+
+// Images with the same texels and role (the role decides the format) share one texture. Level 0, or the KTX2
+// container when it is not decoded yet, is hashed with MurmurHash3 x64_128 on the pool; later copies point at the
+// first one and drop their pixels. The hash also keys the textures shared across renderers, see streamer.hpp.
+void dedupImages(ThreadPool &pool, std::vector<Image> &images, const std::vector<TextureRole> &roles) {
+    auto start = std::chrono::steady_clock::now();
+    std::vector<std::future<void>> futures;
+    for (size_t i = 0; i < images.size(); i++) {
+        Image *image = &images[i];
+        if (image->buffer == nullptr && image->ktx2.empty()) {
+            continue;
+        }
+        int header[4] = {image->width, image->height, image->channels, roles[i]};
+        uint64_t seed = hashBytes(header, sizeof(header));
+        futures.push_back(pool.submit([image, seed] {
+            size_t size = (size_t)image->width * image->height * image->channels;
+            Hash128 h = image->buffer ? hash128(image->buffer, size, seed)
+                                      : hash128(image->ktx2.data(), image->ktx2.size(), seed);
+            image->hash[0] = h.h1;
+            image->hash[1] = h.h2;
+        }));
+    }
+    for (auto &f : futures) {
+        f.get();
+    }
+
+    std::map<Hash128, int> first;
+    size_t duplicates = 0, bytes = 0;
+    for (size_t i = 0; i < images.size(); i++) {
+        Image &image = images[i];
+        if (image.buffer == nullptr && image.ktx2.empty()) {
+            continue;
+        }
+        auto [it, inserted] = first.try_emplace(Hash128{image.hash[0], image.hash[1]}, i);
+        if (inserted) {
+            continue;
+        }
+        duplicates++;
+        bytes += image.buffer ? (size_t)image.width * image.height * image.channels : image.ktx2.size();
+        free(image.buffer);
+        image.buffer = nullptr;
+        image.ktx2 = {};
+        image.duplicate = it->second;
+    }
+    auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start);
+    std::cout << "dedup: " << duplicates << " duplicate images, " << (bytes >> 10) << " KB, hashed in " << ms.count()
+              << " ms" << std::endl;
+}
@@ -0,0 +1,171 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <future>
+#include <iostream>
+#include <vector>
+
+#ifdef REDCUBE_DRACO
+#include <draco/compression/decode.h>
+#endif
+
+// Output of the KHR_draco_mesh_compression jobs, summed up for the load log.
+struct DracoStats {
+    std::atomic<size_t> bytes = 0;
+    std::atomic<size_t> triangles = 0;
+    std::atomic<int> primitives = 0;
+    std::atomic<int64_t> microseconds = 0;
+};
+
+#ifdef REDCUBE_DRACO
+template <typename T>
+void copyDracoAttribute(const draco::Mesh &mesh, const draco::PointAttribute &attribute, Buffer &g) {
+    g.data.resize(g.count * g.components * sizeof(T));
+    T *out = (T *)g.data.data();
+    for (uint32_t i = 0; i < mesh.num_points() && i < (uint32_t)g.count; i++) {
+        attribute.ConvertValue<T>(attribute.mapped_index(draco::PointIndex(i)), g.components, out + i * g.components);
+    }
+}
+
+void copyDracoAttribute(const draco::Mesh &mesh, const draco::PointAttribute &attribute, Buffer &g) {
+    switch (g.componentType) {
+        case 5120:
+            copyDracoAttribute<int8_t>(mesh, attribute, g);
+            break;
+        case 5121:
+            copyDracoAttribute<uint8_t>(mesh, attribute, g);
+            break;
+        case 5122:
+            copyDracoAttribute<int16_t>(mesh, attribute, g);
+            break;
+        case 5123:
+            copyDracoAttribute<uint16_t>(mesh, attribute, g);
+            break;
+        case 5125:
+            copyDracoAttribute<uint32_t>(mesh, attribute, g);
+            break;
+        default:
+            copyDracoAttribute<float>(mesh, attribute, g);
+            break;
+    }
+}
+
+template <typename T>
+void copyDracoIndices(const draco::Mesh &mesh, Buffer &g) {
+    g.data.resize(g.count * sizeof(T));
+    T *out = (T *)g.data.data();
+    for (uint32_t f = 0; f < mesh.num_faces() && f * 3 + 2 < (uint32_t)g.count; f++) {
+        const draco::Mesh::Face &face = mesh.face(draco::FaceIndex(f));
+        for (int k = 0; k < 3; k++) {
+            out[f * 3 + k] = (T)face[k].value();
+        }
+    }
+}
+#endif
+
+// A compressed primitive as plain values, read from the json before its job is queued so jobs never touch it.
+struct DracoPrimitive {
+    size_t offset; // of the compressed bufferView
+    size_t length;
+    std::vector<std::pair<int, int>> attributes; // Draco unique id, accessor
+    int indices = -1;
+};
+
+DracoPrimitive getDracoPrimitive(json &primitive, json &data) {
+    json &draco = primitive["extensions"]["KHR_draco_mesh_compression"];
+    json &view = data["bufferViews"][(int)draco["bufferView"]];
+    DracoPrimitive r{view.value("byteOffset", (size_t)0), view["byteLength"]};
+    for (auto &[name, id] : draco["attributes"].items()) {
+        if (primitive["attributes"].contains(name)) {
+            r.attributes.emplace_back((int)id, (int)primitive["attributes"][name]);
+        }
+    }
+    r.indices = primitive.value("indices", -1);
+    return r;
+}
+
+// Decodes one compressed primitive into the owned data of its accessors, which buildBuffers() uploads as is.
+void decodeDracoPrimitive(const DracoPrimitive &primitive,
+                          std::vector<Buffer> &geometries,
+                          const std::vector<unsigned char> &buffer,
+                          DracoStats &stats) {
+    size_t offset = primitive.offset;
+    size_t length = primitive.length;
+#ifdef REDCUBE_DRACO
+    auto start = std::chrono::steady_clock::now();
+    draco::DecoderBuffer source;
+    source.Init((const char *)buffer.data() + offset, length);
+    draco::Decoder decoder;
+    auto decoded = decoder.DecodeMeshFromBuffer(&source);
+    if (!decoded.ok()) {
+        std::cout << "unable to decode draco primitive: " << decoded.status().error_msg_string() << std::endl;
+        return;
+    }
+    std::unique_ptr<draco::Mesh> mesh = std::move(decoded).value();
+
+    for (auto &[id, accessor] : primitive.attributes) {
+        const draco::PointAttribute *attribute = mesh->GetAttributeByUniqueId(id);
+        if (attribute != nullptr) {
+            copyDracoAttribute(*mesh, *attribute, geometries[accessor]);
+        }
+    }
+    if (primitive.indices != -1) {
+        Buffer &g = geometries[primitive.indices];
+        switch (g.componentType) {
+            case 5121:
+                copyDracoIndices<uint8_t>(*mesh, g);
+                break;
+            case 5123:
+                copyDracoIndices<uint16_t>(*mesh, g);
+                break;
+            default:
+                copyDracoIndices<uint32_t>(*mesh, g);
+                break;
+        }
+    }
+    stats.bytes += length;
+    stats.triangles += mesh->num_faces();
+    stats.primitives++;
+    stats.microseconds +=
+        std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+#else
+    std::cout << "unable to decode draco primitive: built without REDCUBE_DRACO" << std::endl;
+#endif
+}
+
+// Queues every Draco compressed primitive on the pool; the caller keeps loading images meanwhile and waits on the
+// returned futures before touching the decoded accessors.
+std::vector<std::future<void>> decodeDraco(ThreadPool &pool,
+                                           json &data,
+                                           std::vector<Buffer> &geometries,
+                                           const std::vector<unsigned char> &buffer,
+                                           const std::vector<bool> &reachable,
+                                           DracoStats &stats) {
+    std::vector<std::future<void>> r;
+    for (size_t m = 0; m < data["meshes"].size(); m++) {
+        if (!reachable[m]) {
+            continue;
+        }
+        for (auto &primitive : data["meshes"][m]["primitives"]) {
+            if (primitive.contains("extensions") && primitive["extensions"].contains("KHR_draco_mesh_compression")) {
+                r.push_back(pool.submit([p = getDracoPrimitive(primitive, data), &geometries, &buffer, &stats] {
+                    decodeDracoPrimitive(p, geometries, buffer, stats);
+                }));
+            }
+        }
+    }
+    return r;
+}
+
+void printDracoStats(DracoStats &stats) {
+    if (stats.primitives == 0) {
+        return;
+    }
+    // throughput of a single worker, the jobs themselves run side by side
+    double seconds = std::max(stats.microseconds.load(), int64_t(1)) / 1e6;
+    std::cout << "draco: " << stats.primitives << " primitives, " << stats.bytes / 1024 << " KB in "
+              << seconds * 1000.0 << " ms (" << stats.bytes / seconds / 1e6 << " MB/s, " << stats.triangles / seconds
+              << " tris/s per worker)" << std::endl;
+}
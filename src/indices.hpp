@@ -0,0 +1,113 @@
+#include <algorithm>
+#include <cstdint>
+#include <iostream>
+#include <vector>
+
+#if defined(__ARM_NEON)
+#include <arm_neon.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+void widenIndices(const uint8_t *src, uint16_t *dst, size_t count) {
+    size_t i = 0;
+#if defined(__ARM_NEON)
+    for (; i + 16 <= count; i += 16) {
+        uint8x16_t v = vld1q_u8(src + i);
+        vst1q_u16(dst + i, vmovl_u8(vget_low_u8(v)));
+        vst1q_u16(dst + i + 8, vmovl_u8(vget_high_u8(v)));
+    }
+#elif defined(__SSE2__)
+    __m128i zero = _mm_setzero_si128();
+    for (; i + 16 <= count; i += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i *)(src + i));
+        _mm_storeu_si128((__m128i *)(dst + i), _mm_unpacklo_epi8(v, zero));
+        _mm_storeu_si128((__m128i *)(dst + i + 8), _mm_unpackhi_epi8(v, zero));
+    }
+#endif
+    for (; i < count; i++) {
+        dst[i] = src[i];
+    }
+}
+
+// every index minus base has to fit into 16 bits
+void narrowIndices(const uint32_t *src, uint16_t *dst, size_t count, uint32_t base) {
+    size_t i = 0;
+#if defined(__ARM_NEON)
+    uint32x4_t b = vdupq_n_u32(base);
+    for (; i + 8 <= count; i += 8) {
+        uint16x4_t lo = vmovn_u32(vsubq_u32(vld1q_u32(src + i), b));
+        uint16x4_t hi = vmovn_u32(vsubq_u32(vld1q_u32(src + i + 4), b));
+        vst1q_u16(dst + i, vcombine_u16(lo, hi));
+    }
+#elif defined(__SSE2__)
+    // SSE2 only has a signed pack, so shift into the signed range and flip the sign bit back afterwards
+    __m128i b = _mm_set1_epi32((int)base + 32768);
+    __m128i sign = _mm_set1_epi16((short)0x8000);
+    for (; i + 8 <= count; i += 8) {
+        __m128i lo = _mm_sub_epi32(_mm_loadu_si128((const __m128i *)(src + i)), b);
+        __m128i hi = _mm_sub_epi32(_mm_loadu_si128((const __m128i *)(src + i + 4)), b);
+        _mm_storeu_si128((__m128i *)(dst + i), _mm_xor_si128(_mm_packs_epi32(lo, hi), sign));
+    }
+#endif
+    for (; i < count; i++) {
+        dst[i] = (uint16_t)(src[i] - base);
+    }
+}
+
+// Picks the GPU format of every index accessor used by a mesh or one of its LODs: byte indices are widened to 16 bits (Metal has
+// no 8 bit index type) and 32 bit indices are narrowed to 16 bits when the referenced vertex range fits,
+// rebased with baseVertex. The actual conversion happens in writeIndices() straight into the upload buffer.
+void compactIndices(std::vector<Mesh> &meshes, std::vector<Buffer> &geometries, const std::vector<unsigned char> &buffer) {
+    size_t saved = 0;
+    int narrowed = 0;
+    std::vector<int> accessors;
+    for (auto &mesh : meshes) {
+        accessors.push_back(mesh.geometry->index);
+        for (const Lod &lod : mesh.geometry->lods) {
+            accessors.push_back(lod.index);
+        }
+    }
+    for (int accessor : accessors) {
+        Buffer &g = geometries[accessor];
+        if (g.indices) {
+            continue;
+        }
+        g.indices = true;
+        g.baseVertex = 0;
+        g.sizeofComponent = g.componentType == 5125 ? 4 : 2;
+        if (g.componentType != 5125 || g.count == 0) {
+            continue;
+        }
+
+        const uint32_t *p = (const uint32_t *)getData(g, buffer);
+        uint32_t min = UINT32_MAX;
+        uint32_t max = 0;
+        for (int i = 0; i < g.count; i++) {
+            min = std::min(min, p[i]);
+            max = std::max(max, p[i]);
+        }
+        // 0xFFFF is the primitive restart index
+        if (max - min < 0xFFFF) {
+            g.sizeofComponent = 2;
+            g.baseVertex = min;
+            saved += g.count * 2;
+            narrowed++;
+        }
+    }
+    if (narrowed > 0) {
+        std::cout << "indices: narrowed " << narrowed << " accessors to 16 bit, saved " << saved / 1024 << " KB"
+                  << std::endl;
+    }
+}
+
+void writeIndices(Buffer &g, const std::vector<unsigned char> &buffer, void *dst) {
+    const unsigned char *src = getData(g, buffer);
+    if (g.componentType == 5121) {
+        widenIndices(src, (uint16_t *)dst, g.count);
+    } else if (g.componentType == 5125 && g.sizeofComponent == 2) {
+        narrowIndices((const uint32_t *)src, (uint16_t *)dst, g.count, g.baseVertex);
+    } else {
+        memcpy(dst, src, g.count * g.sizeofComponent);
+    }
+}
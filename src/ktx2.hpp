@@ -0,0 +1,267 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <future>
+#include <iostream>
+#include <mutex>
+#include <vector>
+
+#ifdef REDCUBE_ZSTD
+#include <zstd.h>
+#endif
+#ifdef REDCUBE_BASISU
+#include <basisu_transcoder.h>
+#endif
+
+// KTX2 containers (KHR_texture_basisu and plain KTX2 images). Levels stored in a format Metal samples directly
+// (RGBA8, BC4, BC5, BC7), optionally zstd supercompressed, are used as they are; Basis Universal (ETC1S / UASTC)
+// payloads are transcoded to BC7, or BC5 for normal maps. zstd and basisu are optional, see CMakeLists.txt.
+
+const unsigned char kKtx2Identifier[12] = {0xAB, 'K', 'T', 'X', ' ', '2', '0', 0xBB, '\r', '\n', 0x1A, '\n'};
+
+enum Ktx2Supercompression {
+    Ktx2None = 0,
+    Ktx2BasisLZ = 1,
+    Ktx2Zstd = 2,
+};
+
+struct Ktx2Level {
+    uint64_t offset;
+    uint64_t length;
+    uint64_t uncompressedLength;
+};
+
+struct Ktx2Header {
+    uint32_t vkFormat;
+    uint32_t width;
+    uint32_t height;
+    uint32_t levelCount;
+    uint32_t supercompression;
+    std::vector<Ktx2Level> levels;
+};
+
+bool isKtx2(const std::vector<char> &res) {
+    return res.size() >= 12 && memcmp(res.data(), kKtx2Identifier, 12) == 0;
+}
+
+template <typename T>
+T readKtx2(const unsigned char *p, size_t offset) {
+    T v;
+    memcpy(&v, p + offset, sizeof(T));
+    return v;
+}
+
+bool parseKtx2(const std::vector<unsigned char> &data, Ktx2Header &header) {
+    if (data.size() < 80 || memcmp(data.data(), kKtx2Identifier, 12) != 0) {
+        return false;
+    }
+    const unsigned char *p = data.data();
+    header.vkFormat = readKtx2<uint32_t>(p, 12);
+    header.width = readKtx2<uint32_t>(p, 20);
+    header.height = std::max(readKtx2<uint32_t>(p, 24), 1u);
+    uint32_t depth = readKtx2<uint32_t>(p, 28);
+    uint32_t layers = readKtx2<uint32_t>(p, 32);
+    uint32_t faces = readKtx2<uint32_t>(p, 36);
+    header.levelCount = std::max(readKtx2<uint32_t>(p, 40), 1u);
+    header.supercompression = readKtx2<uint32_t>(p, 44);
+    if (depth > 1 || layers > 1 || faces != 1) {
+        std::cout << "unsupported ktx2 image: only single 2d images are handled" << std::endl;
+        return false;
+    }
+    // a full chain ends at 1x1, more levels than that are malformed
+    uint32_t maxLevels = 1;
+    while (maxLevels < 32 && std::max(header.width, header.height) >> maxLevels) {
+        maxLevels++;
+    }
+    // sizes and offsets are 64 bit values from the file, compared without sums that could wrap
+    if (header.width == 0 || header.levelCount > maxLevels || data.size() < 80 + (uint64_t)header.levelCount * 24) {
+        return false;
+    }
+    for (uint32_t i = 0; i < header.levelCount; i++) {
+        Ktx2Level level{readKtx2<uint64_t>(p, 80 + i * 24),
+                        readKtx2<uint64_t>(p, 88 + i * 24),
+                        readKtx2<uint64_t>(p, 96 + i * 24)};
+        if (level.offset > data.size() || level.length > data.size() - level.offset) {
+            return false;
+        }
+        header.levels.push_back(level);
+    }
+    return true;
+}
+
+// the container is kept and decoded once the texture roles are known, see transcodeImages()
+Image loadKtx2(const std::vector<char> &res) {
+    Image image(0, 0, 4, nullptr);
+    image.ktx2.assign(res.begin(), res.end());
+    Ktx2Header header;
+    if (!parseKtx2(image.ktx2, header)) {
+        image.ktx2.clear();
+        return image;
+    }
+    image.width = header.width;
+    image.height = header.height;
+    return image;
+}
+
+BlockFormat getKtx2BlockFormat(uint32_t vkFormat) {
+    switch (vkFormat) {
+        case 139: // VK_FORMAT_BC4_UNORM_BLOCK
+            return BlockBC4;
+        case 141: // VK_FORMAT_BC5_UNORM_BLOCK
+            return BlockBC5;
+        case 145: // VK_FORMAT_BC7_UNORM_BLOCK
+        case 146: // VK_FORMAT_BC7_SRGB_BLOCK
+            return BlockBC7;
+        default:
+            return BlockNone;
+    }
+}
+
+bool isKtx2Rgba8(uint32_t vkFormat) {
+    return vkFormat == 37 || vkFormat == 43; // VK_FORMAT_R8G8B8A8_UNORM / _SRGB
+}
+
+// Bytes of one level as the streamer uploads it (see getLevelBytes), 0 for formats that are transcoded.
+uint64_t getKtx2LevelSize(const Ktx2Header &header, uint32_t level) {
+    uint64_t width = std::max(header.width >> level, 1u);
+    uint64_t height = std::max(header.height >> level, 1u);
+    if (isKtx2Rgba8(header.vkFormat)) {
+        return width * height * 4;
+    }
+    BlockFormat format = getKtx2BlockFormat(header.vkFormat);
+    if (format == BlockNone) {
+        return 0;
+    }
+    return ((width + 3) / 4) * ((height + 3) / 4) * (format == BlockBC4 ? 8 : 16);
+}
+
+// One level of a non Basis container, zstd inflated when needed. A level whose size does not match its dimensions
+// is rejected, the upload would read past it otherwise.
+bool readKtx2Level(const std::vector<unsigned char> &data, const Ktx2Header &header, int level,
+                   std::vector<unsigned char> &out) {
+    const Ktx2Level &l = header.levels[level];
+    const unsigned char *src = data.data() + l.offset;
+    uint64_t size = getKtx2LevelSize(header, level);
+    if (header.supercompression == Ktx2None) {
+        if (l.length != size) {
+            return false;
+        }
+        out.assign(src, src + l.length);
+        return true;
+    }
+#ifdef REDCUBE_ZSTD
+    if (header.supercompression == Ktx2Zstd) {
+        if (l.uncompressedLength != size) {
+            return false;
+        }
+        out.resize(l.uncompressedLength);
+        size_t inflated = ZSTD_decompress(out.data(), out.size(), src, l.length);
+        return !ZSTD_isError(inflated) && inflated == out.size();
+    }
+#endif
+    return false;
+}
+
+#ifdef REDCUBE_BASISU
+bool transcodeKtx2Level(const std::vector<unsigned char> &data, int level, BlockFormat format,
+                        std::vector<unsigned char> &out) {
+    basist::ktx2_transcoder transcoder;
+    if (!transcoder.init(data.data(), data.size()) || !transcoder.start_transcoding()) {
+        return false;
+    }
+    uint32_t width = std::max(transcoder.get_width() >> level, 1u);
+    uint32_t height = std::max(transcoder.get_height() >> level, 1u);
+    uint32_t blocks = ((width + 3) / 4) * ((height + 3) / 4);
+    basist::transcoder_texture_format target =
+        format == BlockBC5 ? basist::transcoder_texture_format::cTFBC5_RG : basist::transcoder_texture_format::cTFBC7_RGBA;
+    out.resize(blocks * 16);
+    return transcoder.transcode_image_level(level, 0, 0, out.data(), blocks, target);
+}
+#endif
+
+// Decodes the pending KTX2 images, one job per mip level on the pool.
+void transcodeImages(ThreadPool &pool, std::vector<Image> &images, const std::vector<TextureRole> &roles) {
+    auto start = std::chrono::steady_clock::now();
+#ifdef REDCUBE_BASISU
+    static std::once_flag init;
+    std::call_once(init, [] { basist::basisu_transcoder_init(); });
+#endif
+    std::vector<std::pair<size_t, std::vector<std::future<bool>>>> jobs;
+    for (size_t i = 0; i < images.size(); i++) {
+        Image &image = images[i];
+        Ktx2Header header;
+        if (image.ktx2.empty() || !parseKtx2(image.ktx2, header)) {
+            continue;
+        }
+        bool basis = header.vkFormat == 0;
+        BlockFormat format = getKtx2BlockFormat(header.vkFormat);
+        if (basis) {
+            format = roles[i] == TextureNormal ? BlockBC5 : BlockBC7;
+        } else if (format == BlockNone && !isKtx2Rgba8(header.vkFormat)) {
+            std::cout << "unsupported ktx2 format " << header.vkFormat << " in image " << i << std::endl;
+            continue;
+        }
+
+        std::vector<std::vector<unsigned char>> *levels = &image.compressed;
+        if (format == BlockNone) {
+            levels = &image.mips;
+        }
+        levels->resize(format == BlockNone ? header.levelCount - 1 : header.levelCount);
+        image.format = format;
+
+        std::vector<std::future<bool>> futures;
+        for (uint32_t level = 0; level < header.levelCount; level++) {
+            futures.push_back(pool.submit([&image, header, level, format, basis, levels] {
+                std::vector<unsigned char> out;
+                bool ok = false;
+                if (basis) {
+#ifdef REDCUBE_BASISU
+                    ok = transcodeKtx2Level(image.ktx2, level, format, out);
+#endif
+                } else {
+                    ok = readKtx2Level(image.ktx2, header, level, out);
+                }
+                if (!ok) {
+                    return false;
+                }
+                if (format != BlockNone) {
+                    (*levels)[level] = std::move(out);
+                } else if (level > 0) {
+                    (*levels)[level - 1] = std::move(out);
+                } else {
+                    image.buffer = (unsigned char *)malloc(out.size());
+                    memcpy(image.buffer, out.data(), out.size());
+                }
+                return true;
+            }));
+        }
+        jobs.emplace_back(i, std::move(futures));
+    }
+
+    int count = 0;
+    for (auto &[i, futures] : jobs) {
+        bool ok = true;
+        for (auto &f : futures) {
+            ok = f.get() && ok;
+        }
+        Image &image = images[i];
+        image.ktx2.clear();
+        image.ktx2.shrink_to_fit();
+        if (!ok) {
+            std::cout << "unable to decode ktx2 image " << i << std::endl;
+            free(image.buffer);
+            image = Image(0, 0, 0, nullptr);
+            continue;
+        }
+        count++;
+    }
+    if (!jobs.empty()) {
+        auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start);
+        std::cout << "ktx2: " << count << " images in " << ms.count() << " ms" << std::endl;
+    }
+}
+
+bool hasPixels(const Image &image) {
+    return image.buffer != nullptr || !image.compressed.empty();
+}
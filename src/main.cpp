@@ -16,6 +16,7 @@
  */
 
 #include <cassert>
+#include <cstring>
 #include <queue>
 
 #define NS_PRIVATE_IMPLEMENTATION
@@ -109,6 +110,10 @@ void MyMTKViewDelegate::drawInMTKView(MTK::View *pView) {
 }
 
 int main(int argc, char *argv[]) {
+    if (argc == 3 && strcmp(argv[1], "--bench-decoders") == 0) {
+        return benchDecoders(argv[2]);
+    }
+
     NS::AutoreleasePool *pAutoreleasePool = NS::AutoreleasePool::alloc()->init();
 
     MyAppDelegate del;
@@ -0,0 +1,213 @@
+#include <cmath>
+#include <cstdint>
+#include <iostream>
+#include <vector>
+
+void computeMeshletBounds(Meshlets &r, Meshlet &m, const std::vector<float> &positions) {
+    float min[3] = {INFINITY, INFINITY, INFINITY};
+    float max[3] = {-INFINITY, -INFINITY, -INFINITY};
+    for (uint32_t i = 0; i < m.vertexCount; i++) {
+        const float *p = &positions[r.vertices[m.vertexOffset + i] * 3];
+        for (int c = 0; c < 3; c++) {
+            min[c] = fminf(min[c], p[c]);
+            max[c] = fmaxf(max[c], p[c]);
+        }
+    }
+    float radius = 0.0f;
+    for (int c = 0; c < 3; c++) {
+        m.center[c] = (min[c] + max[c]) * 0.5f;
+    }
+    for (uint32_t i = 0; i < m.vertexCount; i++) {
+        const float *p = &positions[r.vertices[m.vertexOffset + i] * 3];
+        float dx = p[0] - m.center[0], dy = p[1] - m.center[1], dz = p[2] - m.center[2];
+        radius = fmaxf(radius, dx * dx + dy * dy + dz * dz);
+    }
+    m.radius = sqrtf(radius);
+
+    std::vector<float> normals;
+    float axis[3] = {0.0f, 0.0f, 0.0f};
+    for (uint32_t t = 0; t < m.triangleCount; t++) {
+        const uint8_t *tri = &r.triangles[m.triangleOffset + t * 3];
+        const float *a = &positions[r.vertices[m.vertexOffset + tri[0]] * 3];
+        const float *b = &positions[r.vertices[m.vertexOffset + tri[1]] * 3];
+        const float *c = &positions[r.vertices[m.vertexOffset + tri[2]] * 3];
+        float e1[3] = {b[0] - a[0], b[1] - a[1], b[2] - a[2]};
+        float e2[3] = {c[0] - a[0], c[1] - a[1], c[2] - a[2]};
+        float n[3] = {e1[1] * e2[2] - e1[2] * e2[1], e1[2] * e2[0] - e1[0] * e2[2], e1[0] * e2[1] - e1[1] * e2[0]};
+        float l = sqrtf(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+        if (l == 0.0f) {
+            continue;
+        }
+        for (int k = 0; k < 3; k++) {
+            normals.push_back(n[k] / l);
+            axis[k] += n[k] / l;
+        }
+    }
+    float l = sqrtf(axis[0] * axis[0] + axis[1] * axis[1] + axis[2] * axis[2]);
+    float mindp = 1.0f;
+    for (size_t i = 0; i < normals.size(); i += 3) {
+        float dp = (normals[i] * axis[0] + normals[i + 1] * axis[1] + normals[i + 2] * axis[2]) / l;
+        mindp = fminf(mindp, dp);
+    }
+    for (int k = 0; k < 3; k++) {
+        m.coneAxis[k] = l > 0.0f ? axis[k] / l : 0.0f;
+    }
+    // a cone wider than ~84 degrees never culls anything, a cutoff of 1 disables the test
+    m.coneCutoff = (l == 0.0f || mindp <= 0.1f) ? 1.0f : sqrtf(1.0f - mindp * mindp);
+}
+
+// SoA copy of the meshlet spheres and cones, padded to a multiple of four for cullMeshlets()
+void buildMeshletBounds(Meshlets &r) {
+    size_t padded = (r.meshlets.size() + 3) & ~size_t(3);
+    for (auto &b : r.bounds) {
+        b.assign(padded, 0.0f);
+    }
+    for (size_t i = 0; i < r.meshlets.size(); i++) {
+        const Meshlet &mm = r.meshlets[i];
+        float values[8] = {mm.center[0],
+                           mm.center[1],
+                           mm.center[2],
+                           mm.radius,
+                           mm.coneAxis[0],
+                           mm.coneAxis[1],
+                           mm.coneAxis[2],
+                           mm.coneCutoff};
+        for (int k = 0; k < 8; k++) {
+            r.bounds[k][i] = values[k];
+        }
+    }
+}
+
+// Greedy scan in index order, so every meshlet also is a contiguous range of the source index buffer.
+Meshlets buildMeshlets(const std::vector<uint32_t> &indices,
+                       const std::vector<float> &positions,
+                       uint32_t maxVertices = 64,
+                       uint32_t maxTriangles = 124) {
+    Meshlets r;
+    std::vector<int> local(positions.size() / 3, -1);
+    Meshlet m{};
+
+    auto flush = [&](uint32_t nextIndex) {
+        if (m.triangleCount == 0) {
+            return;
+        }
+        computeMeshletBounds(r, m, positions);
+        for (uint32_t i = 0; i < m.vertexCount; i++) {
+            local[r.vertices[m.vertexOffset + i]] = -1;
+        }
+        r.meshlets.push_back(m);
+        m = Meshlet{};
+        m.vertexOffset = r.vertices.size();
+        m.triangleOffset = r.triangles.size();
+        m.indexOffset = nextIndex;
+    };
+
+    for (size_t i = 0; i + 2 < indices.size(); i += 3) {
+        uint32_t a = indices[i], b = indices[i + 1], c = indices[i + 2];
+        uint32_t extra = (local[a] < 0) + (local[b] < 0 && b != a) + (local[c] < 0 && c != a && c != b);
+        if (m.vertexCount + extra > maxVertices || m.triangleCount >= maxTriangles) {
+            flush(i);
+        }
+        for (uint32_t v : {a, b, c}) {
+            if (local[v] < 0) {
+                local[v] = m.vertexCount++;
+                r.vertices.push_back(v);
+            }
+            r.triangles.push_back(local[v]);
+        }
+        m.triangleCount++;
+    }
+    flush(indices.size());
+    buildMeshletBounds(r);
+    return r;
+}
+
+// Frustum planes in the space mvp transforms from, normalized, pointing inside.
+void getFrustumPlanes(const glm::mat4 &mvp, float planes[6][4]) {
+    for (int p = 0; p < 6; p++) {
+        int row = p / 2;
+        float sign = p % 2 ? -1.0f : 1.0f;
+        for (int c = 0; c < 4; c++) {
+            planes[p][c] = mvp[c][3] + sign * mvp[c][row];
+        }
+        float l = sqrtf(planes[p][0] * planes[p][0] + planes[p][1] * planes[p][1] + planes[p][2] * planes[p][2]);
+        for (int c = 0; c < 4; c++) {
+            planes[p][c] /= l;
+        }
+    }
+}
+
+// Sphere against frustum and, when cone is set, normal cone backface test; four meshlets per iteration.
+// planes and eye are in the space of the meshlet positions. Returns the indices of the visible meshlets.
+std::vector<uint32_t> cullMeshlets(const Meshlets &r, const float planes[6][4], const float *eye, bool cone) {
+    std::vector<uint32_t> visible;
+    visible.reserve(r.meshlets.size());
+    float4 zero = splat4(0.0f);
+    for (size_t i = 0; i < r.bounds[0].size(); i += 4) {
+        float4 cx = load4(&r.bounds[0][i]);
+        float4 cy = load4(&r.bounds[1][i]);
+        float4 cz = load4(&r.bounds[2][i]);
+        float4 radius = load4(&r.bounds[3][i]);
+        float4 negRadius = sub4(zero, radius);
+
+        int mask = 15;
+        for (int p = 0; p < 6; p++) {
+            float4 d = add4(add4(mul4(cx, splat4(planes[p][0])), mul4(cy, splat4(planes[p][1]))),
+                            add4(mul4(cz, splat4(planes[p][2])), splat4(planes[p][3])));
+            mask &= gemask4(d, negRadius);
+        }
+        if (cone && mask) {
+            float4 dx = sub4(cx, splat4(eye[0]));
+            float4 dy = sub4(cy, splat4(eye[1]));
+            float4 dz = sub4(cz, splat4(eye[2]));
+            float4 distance = sqrt4(add4(add4(mul4(dx, dx), mul4(dy, dy)), mul4(dz, dz)));
+            float4 d = add4(add4(mul4(dx, load4(&r.bounds[4][i])), mul4(dy, load4(&r.bounds[5][i]))),
+                            mul4(dz, load4(&r.bounds[6][i])));
+            float4 limit = add4(mul4(load4(&r.bounds[7][i]), distance), radius);
+            mask &= ~gemask4(d, limit);
+        }
+        for (int k = 0; k < 4; k++) {
+            if (mask & (1 << k) && i + k < r.meshlets.size()) {
+                visible.push_back(i + k);
+            }
+        }
+    }
+    return visible;
+}
+
+// Meshlets of every mesh. A mesh that already has ranges (the per primitive ranges of batchMeshes()) is split range
+// by range, so no meshlet straddles two source primitives.
+std::vector<Meshlets> buildClusters(std::vector<Mesh> &meshes,
+                                    std::vector<Buffer> &geometries,
+                                    const std::vector<unsigned char> &buffer,
+                                    const std::vector<Meshlets> &ranges) {
+    std::vector<Meshlets> r;
+    size_t count = 0;
+    for (size_t i = 0; i < meshes.size(); i++) {
+        std::vector<uint32_t> indices = readIndices(geometries[meshes[i].geometry->index], buffer);
+        std::vector<float> positions = readFloats(geometries[meshes[i].geometry->position], buffer);
+        if (i >= ranges.size() || ranges[i].meshlets.empty()) {
+            r.push_back(buildMeshlets(indices, positions));
+            count += r.back().meshlets.size();
+            continue;
+        }
+        Meshlets merged;
+        for (const Meshlet &range : ranges[i].meshlets) {
+            auto first = indices.begin() + range.indexOffset;
+            Meshlets part = buildMeshlets(std::vector<uint32_t>(first, first + range.triangleCount * 3), positions);
+            for (Meshlet m : part.meshlets) {
+                m.vertexOffset += merged.vertices.size();
+                m.triangleOffset += merged.triangles.size();
+                m.indexOffset += range.indexOffset;
+                merged.meshlets.push_back(m);
+            }
+            merged.vertices.insert(merged.vertices.end(), part.vertices.begin(), part.vertices.end());
+            merged.triangles.insert(merged.triangles.end(), part.triangles.begin(), part.triangles.end());
+        }
+        buildMeshletBounds(merged);
+        count += merged.meshlets.size();
+        r.push_back(std::move(merged));
+    }
+    std::cout << "meshlets: " << count << std::endl;
+    return r;
+}
@@ -0,0 +1,472 @@
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <string>
+
+#if defined(__ARM_NEON)
+#include <arm_neon.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+// Decoders for the EXT_meshopt_compression bitstreams (vertex codec v0, index codec v1, index sequence v1)
+// and filters, following the format described in the extension spec.
+
+const size_t kMeshoptGroupSize = 16;
+const size_t kMeshoptBlockMaxSize = 256;
+const size_t kMeshoptBlockSizeBytes = 8192;
+const size_t kMeshoptTailMinSize = 32;
+const size_t kMeshoptGroupDecodeLimit = 24;
+
+size_t getMeshoptBlockSize(size_t vertexSize) {
+    size_t r = (kMeshoptBlockSizeBytes / vertexSize) & ~(kMeshoptGroupSize - 1);
+    return r < kMeshoptBlockMaxSize ? r : kMeshoptBlockMaxSize;
+}
+
+const unsigned char *decodeBytesGroup(const unsigned char *data, unsigned char *out, int bitslog2) {
+    if (bitslog2 == 0) {
+        memset(out, 0, kMeshoptGroupSize);
+        return data;
+    }
+    if (bitslog2 == 3) {
+        memcpy(out, data, kMeshoptGroupSize);
+        return data + kMeshoptGroupSize;
+    }
+    // 2 or 4 bit values, the all ones value means the byte follows after the packed bits
+    int bits = bitslog2 == 1 ? 2 : 4;
+    int perByte = 8 / bits;
+    int sentinel = (1 << bits) - 1;
+    const unsigned char *extra = data + kMeshoptGroupSize / perByte;
+    for (size_t i = 0; i < kMeshoptGroupSize / perByte; i++) {
+        unsigned char byte = data[i];
+        for (int k = 0; k < perByte; k++) {
+            int enc = byte >> (8 - bits);
+            byte <<= bits;
+            out[i * perByte + k] = enc == sentinel ? *extra : enc;
+            extra += enc == sentinel;
+        }
+    }
+    return extra;
+}
+
+const unsigned char *decodeBytes(const unsigned char *data,
+                                 const unsigned char *end,
+                                 unsigned char *out,
+                                 size_t size) {
+    size_t headerSize = (size / kMeshoptGroupSize + 3) / 4;
+    if ((size_t)(end - data) < headerSize) {
+        return nullptr;
+    }
+    const unsigned char *header = data;
+    data += headerSize;
+    for (size_t i = 0; i < size; i += kMeshoptGroupSize) {
+        if ((size_t)(end - data) < kMeshoptGroupDecodeLimit) {
+            return nullptr;
+        }
+        size_t group = i / kMeshoptGroupSize;
+        int bitslog2 = (header[group / 4] >> ((group % 4) * 2)) & 3;
+        data = decodeBytesGroup(data, out + i, bitslog2);
+    }
+    return data;
+}
+
+// zigzag decode and running sum over the byte deltas of one attribute byte, 16 vertices per step
+void decodeDeltas(unsigned char *values, size_t count, unsigned char last) {
+    size_t i = 0;
+#if defined(__ARM_NEON)
+    uint8x16_t zero = vdupq_n_u8(0);
+    uint8x16_t one = vdupq_n_u8(1);
+    for (; i + 16 <= count; i += 16) {
+        uint8x16_t v = vld1q_u8(values + i);
+        uint8x16_t sign = vreinterpretq_u8_s8(vnegq_s8(vreinterpretq_s8_u8(vandq_u8(v, one))));
+        v = veorq_u8(vshrq_n_u8(v, 1), sign);
+        v = vaddq_u8(v, vextq_u8(zero, v, 15));
+        v = vaddq_u8(v, vextq_u8(zero, v, 14));
+        v = vaddq_u8(v, vextq_u8(zero, v, 12));
+        v = vaddq_u8(v, vextq_u8(zero, v, 8));
+        v = vaddq_u8(v, vdupq_n_u8(last));
+        vst1q_u8(values + i, v);
+        last = values[i + 15];
+    }
+#elif defined(__SSE2__)
+    __m128i zero = _mm_setzero_si128();
+    __m128i one = _mm_set1_epi8(1);
+    __m128i low = _mm_set1_epi8(0x7f);
+    for (; i + 16 <= count; i += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i *)(values + i));
+        __m128i sign = _mm_sub_epi8(zero, _mm_and_si128(v, one));
+        v = _mm_xor_si128(_mm_and_si128(_mm_srli_epi16(v, 1), low), sign);
+        v = _mm_add_epi8(v, _mm_slli_si128(v, 1));
+        v = _mm_add_epi8(v, _mm_slli_si128(v, 2));
+        v = _mm_add_epi8(v, _mm_slli_si128(v, 4));
+        v = _mm_add_epi8(v, _mm_slli_si128(v, 8));
+        v = _mm_add_epi8(v, _mm_set1_epi8((char)last));
+        _mm_storeu_si128((__m128i *)(values + i), v);
+        last = values[i + 15];
+    }
+#endif
+    for (; i < count; i++) {
+        unsigned char v = values[i];
+        last += (unsigned char)((v >> 1) ^ -(v & 1));
+        values[i] = last;
+    }
+}
+
+const unsigned char *decodeVertexBlock(const unsigned char *data,
+                                       const unsigned char *end,
+                                       unsigned char *out,
+                                       size_t count,
+                                       size_t vertexSize,
+                                       unsigned char *last) {
+    unsigned char values[kMeshoptBlockMaxSize];
+    size_t aligned = (count + kMeshoptGroupSize - 1) & ~(kMeshoptGroupSize - 1);
+    for (size_t k = 0; k < vertexSize; k++) {
+        data = decodeBytes(data, end, values, aligned);
+        if (!data) {
+            return nullptr;
+        }
+        decodeDeltas(values, aligned, last[k]);
+        for (size_t i = 0; i < count; i++) {
+            out[i * vertexSize + k] = values[i];
+        }
+        last[k] = values[count - 1];
+    }
+    return data;
+}
+
+bool decodeVertexBuffer(unsigned char *out, size_t count, size_t vertexSize, const unsigned char *src, size_t size) {
+    if (vertexSize == 0 || vertexSize > 256 || vertexSize % 4 != 0 || size < 1 || (src[0] & 0xf0) != 0xa0) {
+        return false;
+    }
+    if ((src[0] & 0x0f) != 0) {
+        // only version 0 is allowed by EXT_meshopt_compression
+        return false;
+    }
+    const unsigned char *data = src + 1;
+    const unsigned char *end = src + size;
+    size_t tailSize = vertexSize < kMeshoptTailMinSize ? kMeshoptTailMinSize : vertexSize;
+    if ((size_t)(end - data) < tailSize) {
+        return false;
+    }
+    unsigned char last[256];
+    memcpy(last, end - vertexSize, vertexSize);
+
+    size_t blockSize = getMeshoptBlockSize(vertexSize);
+    for (size_t offset = 0; offset < count; offset += blockSize) {
+        size_t n = count - offset < blockSize ? count - offset : blockSize;
+        data = decodeVertexBlock(data, end, out + offset * vertexSize, n, vertexSize, last);
+        if (!data) {
+            return false;
+        }
+    }
+    return (size_t)(end - data) == tailSize;
+}
+
+unsigned int decodeVByte(const unsigned char *&data) {
+    unsigned char lead = *data++;
+    if (lead < 128) {
+        return lead;
+    }
+    unsigned int r = lead & 127;
+    unsigned int shift = 7;
+    for (int i = 0; i < 4; i++) {
+        unsigned char group = *data++;
+        r |= unsigned(group & 127) << shift;
+        shift += 7;
+        if (group < 128) {
+            break;
+        }
+    }
+    return r;
+}
+
+unsigned int decodeIndex(const unsigned char *&data, unsigned int last) {
+    unsigned int v = decodeVByte(data);
+    unsigned int d = (v >> 1) ^ -int(v & 1);
+    return last + d;
+}
+
+void writeIndex(unsigned char *out, size_t i, size_t indexSize, unsigned int v) {
+    if (indexSize == 2) {
+        uint16_t s = (uint16_t)v;
+        memcpy(out + i * 2, &s, 2);
+    } else {
+        memcpy(out + i * 4, &v, 4);
+    }
+}
+
+bool decodeIndexBuffer(unsigned char *out, size_t count, size_t indexSize, const unsigned char *src, size_t size) {
+    if (count % 3 != 0 || (indexSize != 2 && indexSize != 4) || size < 1 + count / 3 + 16) {
+        return false;
+    }
+    if ((src[0] & 0xf0) != 0xe0 || (src[0] & 0x0f) > 1) {
+        return false;
+    }
+
+    unsigned int edges[16][2];
+    unsigned int vertices[16];
+    memset(edges, -1, sizeof(edges));
+    memset(vertices, -1, sizeof(vertices));
+    size_t edgeOffset = 0;
+    size_t vertexOffset = 0;
+    unsigned int next = 0;
+    unsigned int last = 0;
+
+    auto pushVertex = [&](unsigned int v, bool cond = true) {
+        vertices[vertexOffset] = v;
+        vertexOffset = (vertexOffset + cond) & 15;
+    };
+    auto pushEdge = [&](unsigned int a, unsigned int b) {
+        edges[edgeOffset][0] = a;
+        edges[edgeOffset][1] = b;
+        edgeOffset = (edgeOffset + 1) & 15;
+    };
+
+    const unsigned char *code = src + 1;
+    const unsigned char *data = code + count / 3;
+    const unsigned char *safeEnd = src + size - 16;
+    const unsigned char *codeaux = safeEnd;
+    const int fecmax = (src[0] & 0x0f) >= 1 ? 13 : 15;
+
+    for (size_t i = 0; i < count; i += 3) {
+        if (data > safeEnd) {
+            return false;
+        }
+        unsigned char codetri = *code++;
+        unsigned int a, b, c;
+        if (codetri < 0xf0) {
+            int fe = codetri >> 4;
+            a = edges[(edgeOffset - 1 - fe) & 15][0];
+            b = edges[(edgeOffset - 1 - fe) & 15][1];
+            int fec = codetri & 15;
+            if (fec < fecmax) {
+                c = fec == 0 ? next : vertices[(vertexOffset - 1 - fec) & 15];
+                next += fec == 0;
+                pushVertex(c, fec == 0);
+            } else {
+                // 13 and 14 are -1 and +1 from the last free index
+                last = c = fec != 15 ? last + (fec - (fec ^ 3)) : decodeIndex(data, last);
+                pushVertex(c);
+            }
+            pushEdge(c, b);
+            pushEdge(a, c);
+        } else if (codetri < 0xfe) {
+            unsigned char aux = codeaux[codetri & 15];
+            int feb = aux >> 4;
+            int fec = aux & 15;
+            a = next++;
+            b = feb == 0 ? next : vertices[(vertexOffset - feb) & 15];
+            next += feb == 0;
+            c = fec == 0 ? next : vertices[(vertexOffset - fec) & 15];
+            next += fec == 0;
+            pushVertex(a);
+            pushVertex(b, feb == 0);
+            pushVertex(c, fec == 0);
+            pushEdge(b, a);
+            pushEdge(c, b);
+            pushEdge(a, c);
+        } else {
+            unsigned char aux = *data++;
+            int fea = codetri == 0xfe ? 0 : 15;
+            int feb = aux >> 4;
+            int fec = aux & 15;
+            if (aux == 0) {
+                next = 0;
+            }
+            a = fea == 0 ? next++ : 0;
+            b = feb == 0 ? next++ : vertices[(vertexOffset - feb) & 15];
+            c = fec == 0 ? next++ : vertices[(vertexOffset - fec) & 15];
+            if (fea == 15) {
+                last = a = decodeIndex(data, last);
+            }
+            if (feb == 15) {
+                last = b = decodeIndex(data, last);
+            }
+            if (fec == 15) {
+                last = c = decodeIndex(data, last);
+            }
+            pushVertex(a);
+            pushVertex(b, feb == 0 || feb == 15);
+            pushVertex(c, fec == 0 || fec == 15);
+            pushEdge(b, a);
+            pushEdge(c, b);
+            pushEdge(a, c);
+        }
+        writeIndex(out, i, indexSize, a);
+        writeIndex(out, i + 1, indexSize, b);
+        writeIndex(out, i + 2, indexSize, c);
+    }
+    return data == safeEnd;
+}
+
+bool decodeIndexSequence(unsigned char *out, size_t count, size_t indexSize, const unsigned char *src, size_t size) {
+    if ((indexSize != 2 && indexSize != 4) || size < 1 + count + 4) {
+        return false;
+    }
+    if ((src[0] & 0xf0) != 0xd0 || (src[0] & 0x0f) > 1) {
+        return false;
+    }
+    const unsigned char *data = src + 1;
+    const unsigned char *safeEnd = src + size - 4;
+    unsigned int last[2] = {0, 0};
+    for (size_t i = 0; i < count; i++) {
+        if (data >= safeEnd) {
+            return false;
+        }
+        unsigned int v = decodeVByte(data);
+        // the low bit picks one of two baselines, the rest is a zigzag delta
+        unsigned int current = v & 1;
+        v >>= 1;
+        unsigned int d = (v >> 1) ^ -int(v & 1);
+        last[current] += d;
+        writeIndex(out, i, indexSize, last[current]);
+    }
+    return data == safeEnd;
+}
+
+template <typename T>
+void decodeFilterOct(T *data, size_t count) {
+    const float max = float((1 << (sizeof(T) * 8 - 1)) - 1);
+    size_t i = 0;
+    float4 zero = splat4(0.0f);
+    float4 half = splat4(0.5f);
+    for (; i + 4 <= count; i += 4) {
+        float xs[4], ys[4], zs[4];
+        for (int k = 0; k < 4; k++) {
+            xs[k] = float(data[(i + k) * 4 + 0]);
+            ys[k] = float(data[(i + k) * 4 + 1]);
+            zs[k] = float(data[(i + k) * 4 + 2]);
+        }
+        float4 x = load4(xs);
+        float4 y = load4(ys);
+        float4 z = sub4(sub4(load4(zs), abs4(x)), abs4(y));
+        float4 t = min4(z, zero);
+        x = add4(x, xorsign4(t, x));
+        y = add4(y, xorsign4(t, y));
+        float4 l = sqrt4(add4(add4(mul4(x, x), mul4(y, y)), mul4(z, z)));
+        float4 s = div4(splat4(max), l);
+        int32_t xf[4], yf[4], zf[4];
+        truncate4(xf, add4(mul4(x, s), xorsign4(half, x)));
+        truncate4(yf, add4(mul4(y, s), xorsign4(half, y)));
+        truncate4(zf, add4(mul4(z, s), xorsign4(half, z)));
+        for (int k = 0; k < 4; k++) {
+            data[(i + k) * 4 + 0] = T(xf[k]);
+            data[(i + k) * 4 + 1] = T(yf[k]);
+            data[(i + k) * 4 + 2] = T(zf[k]);
+        }
+    }
+    for (; i < count; i++) {
+        float x = float(data[i * 4 + 0]);
+        float y = float(data[i * 4 + 1]);
+        float z = float(data[i * 4 + 2]) - fabsf(x) - fabsf(y);
+        float t = z >= 0.0f ? 0.0f : z;
+        x += x >= 0.0f ? t : -t;
+        y += y >= 0.0f ? t : -t;
+        float s = max / sqrtf(x * x + y * y + z * z);
+        data[i * 4 + 0] = T(int(x * s + (x >= 0.0f ? 0.5f : -0.5f)));
+        data[i * 4 + 1] = T(int(y * s + (y >= 0.0f ? 0.5f : -0.5f)));
+        data[i * 4 + 2] = T(int(z * s + (z >= 0.0f ? 0.5f : -0.5f)));
+    }
+}
+
+void decodeFilterQuat(int16_t *data, size_t count) {
+    const float scale = 1.0f / sqrtf(2.0f);
+    for (size_t i = 0; i < count; i++) {
+        // the two low bits of w hold the index of the dropped component, the rest its scale
+        int sf = data[i * 4 + 3] | 3;
+        float ss = scale / float(sf);
+        float x = float(data[i * 4 + 0]) * ss;
+        float y = float(data[i * 4 + 1]) * ss;
+        float z = float(data[i * 4 + 2]) * ss;
+        float ww = 1.0f - x * x - y * y - z * z;
+        float w = sqrtf(ww >= 0.0f ? ww : 0.0f);
+        int qc = data[i * 4 + 3] & 3;
+        data[i * 4 + ((qc + 1) & 3)] = int16_t(x * 32767.0f + (x >= 0.0f ? 0.5f : -0.5f));
+        data[i * 4 + ((qc + 2) & 3)] = int16_t(y * 32767.0f + (y >= 0.0f ? 0.5f : -0.5f));
+        data[i * 4 + ((qc + 3) & 3)] = int16_t(z * 32767.0f + (z >= 0.0f ? 0.5f : -0.5f));
+        data[i * 4 + ((qc + 0) & 3)] = int16_t(w * 32767.0f + 0.5f);
+    }
+}
+
+// 24 bit signed mantissa and 8 bit signed exponent to float
+void decodeFilterExp(uint32_t *data, size_t count) {
+    size_t i = 0;
+#if defined(__ARM_NEON)
+    for (; i + 4 <= count; i += 4) {
+        int32x4_t v = vreinterpretq_s32_u32(vld1q_u32(data + i));
+        int32x4_t m = vshrq_n_s32(vshlq_n_s32(v, 8), 8);
+        int32x4_t e = vshrq_n_s32(v, 24);
+        float32x4_t f = vreinterpretq_f32_s32(vshlq_n_s32(vaddq_s32(e, vdupq_n_s32(127)), 23));
+        vst1q_u32(data + i, vreinterpretq_u32_f32(vmulq_f32(f, vcvtq_f32_s32(m))));
+    }
+#elif defined(__SSE2__)
+    for (; i + 4 <= count; i += 4) {
+        __m128i v = _mm_loadu_si128((const __m128i *)(data + i));
+        __m128i m = _mm_srai_epi32(_mm_slli_epi32(v, 8), 8);
+        __m128i e = _mm_srai_epi32(v, 24);
+        __m128 f = _mm_castsi128_ps(_mm_slli_epi32(_mm_add_epi32(e, _mm_set1_epi32(127)), 23));
+        _mm_storeu_si128((__m128i *)(data + i), _mm_castps_si128(_mm_mul_ps(f, _mm_cvtepi32_ps(m))));
+    }
+#endif
+    for (; i < count; i++) {
+        uint32_t v = data[i];
+        int m = int(v << 8) >> 8;
+        int e = int(v) >> 24;
+        uint32_t bits = unsigned(e + 127) << 23;
+        float f;
+        memcpy(&f, &bits, 4);
+        f *= float(m);
+        memcpy(&data[i], &f, 4);
+    }
+}
+
+// An EXT_meshopt_compression object as plain values, so decoding jobs never touch the json.
+struct MeshoptView {
+    size_t count;
+    size_t stride;
+    size_t size; // compressed bytes
+    std::string mode;
+    std::string filter;
+};
+
+MeshoptView getMeshoptView(json &meshopt) {
+    return MeshoptView{meshopt["count"],
+                       meshopt["byteStride"],
+                       meshopt["byteLength"],
+                       meshopt["mode"],
+                       meshopt.value("filter", "NONE")};
+}
+
+// Decodes one compressed bufferView into out.
+bool decodeMeshoptView(const MeshoptView &view, const unsigned char *src, unsigned char *out) {
+    size_t count = view.count;
+    size_t stride = view.stride;
+    size_t size = view.size;
+    const std::string &mode = view.mode;
+    const std::string &filter = view.filter;
+
+    bool ok = false;
+    if (mode == "ATTRIBUTES") {
+        ok = decodeVertexBuffer(out, count, stride, src, size);
+    } else if (mode == "TRIANGLES") {
+        ok = decodeIndexBuffer(out, count, stride, src, size);
+    } else if (mode == "INDICES") {
+        ok = decodeIndexSequence(out, count, stride, src, size);
+    }
+    if (!ok) {
+        std::cout << "unable to decode meshopt " << mode << " bufferView" << std::endl;
+        return false;
+    }
+
+    if (filter == "OCTAHEDRAL" && stride == 4) {
+        decodeFilterOct((int8_t *)out, count);
+    } else if (filter == "OCTAHEDRAL" && stride == 8) {
+        decodeFilterOct((int16_t *)out, count);
+    } else if (filter == "QUATERNION") {
+        decodeFilterQuat((int16_t *)out, count);
+    } else if (filter == "EXPONENTIAL") {
+        decodeFilterExp((uint32_t *)out, count * stride / 4);
+    }
+    return true;
+}
@@ -0,0 +1,182 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <future>
+#include <iostream>
+#include <vector>
+
+float srgbToLinear(float c) {
+    return c <= 0.04045f ? c / 12.92f : powf((c + 0.055f) / 1.055f, 2.4f);
+}
+
+float linearToSrgb(float c) {
+    return c <= 0.0031308f ? c * 12.92f : 1.055f * powf(c, 1.0f / 2.4f) - 0.055f;
+}
+
+// 8 bit sRGB -> linear float and 12 bit linear -> 8 bit sRGB, built once
+struct SrgbTables {
+    float toLinear[256];
+    uint8_t toSrgb[4096];
+
+    SrgbTables() {
+        for (int i = 0; i < 256; i++) {
+            toLinear[i] = srgbToLinear(i / 255.0f);
+        }
+        for (int i = 0; i < 4096; i++) {
+            toSrgb[i] = (uint8_t)roundf(linearToSrgb(i / 4095.0f) * 255.0f);
+        }
+    }
+};
+
+const SrgbTables &getSrgbTables() {
+    static SrgbTables tables;
+    return tables;
+}
+
+void decodeRow(const unsigned char *src, int width, TextureRole role, float *out) {
+    const SrgbTables &tables = getSrgbTables();
+    for (int x = 0; x < width * 4; x += 4) {
+        for (int c = 0; c < 3; c++) {
+            float v = src[x + c];
+            out[x + c] = role == TextureColor ? tables.toLinear[src[x + c]]
+                         : role == TextureNormal ? v * (2.0f / 255.0f) - 1.0f
+                                                 : v * (1.0f / 255.0f);
+        }
+        out[x + 3] = src[x + 3] * (1.0f / 255.0f);
+    }
+}
+
+// clamped and quantized four lanes at once, sRGB through the 12 bit table; the normal's length stays scalar
+void encodePixel(const float *p, TextureRole role, unsigned char *out) {
+    float v[4] = {p[0], p[1], p[2], p[3]};
+    if (role == TextureNormal) {
+        float l = sqrtf(v[0] * v[0] + v[1] * v[1] + v[2] * v[2]);
+        for (int c = 0; c < 3; c++) {
+            v[c] = l > 0.0f ? (v[c] / l) * 0.5f + 0.5f : 0.5f;
+        }
+    }
+    float color = role == TextureColor ? 4095.0f : 255.0f;
+    const float scale[4] = {color, color, color, 255.0f};
+    float4 q = min4(max4(load4(v), splat4(0.0f)), splat4(1.0f));
+    int32_t i[4];
+    truncate4(i, add4(mul4(q, load4(scale)), splat4(0.5f)));
+    for (int c = 0; c < 3; c++) {
+        out[c] = role == TextureColor ? getSrgbTables().toSrgb[i[c]] : (unsigned char)i[c];
+    }
+    out[3] = (unsigned char)i[3];
+}
+
+// Source texels of output texel i along an axis of size texels. Even sizes average pairs; odd sizes use the three tap
+// polyphase box filter, so the output covers the source exactly and no row or column is dropped.
+struct MipTaps {
+    int first;
+    int count;
+    float weights[3];
+};
+
+MipTaps getMipTaps(int size, int i) {
+    if (size == 1) {
+        return MipTaps{0, 1, {1.0f}};
+    }
+    if (size % 2 == 0) {
+        return MipTaps{i * 2, 2, {0.5f, 0.5f}};
+    }
+    float n = size / 2;
+    return MipTaps{i * 2, 3, {(n - i) / size, n / size, (i + 1.0f) / size}};
+}
+
+// Box filter of one RGBA8 level to half its size, in linear space for sRGB data. Normals are averaged as vectors and
+// renormalized. The weighted sums are vectorized over the four channels.
+void downsample(const unsigned char *src, int width, int height, unsigned char *dst, TextureRole role) {
+    int w = std::max(width / 2, 1);
+    int h = std::max(height / 2, 1);
+    std::vector<float> rows[3];
+    for (auto &row : rows) {
+        row.resize(width * 4);
+    }
+    for (int y = 0; y < h; y++) {
+        MipTaps ty = getMipTaps(height, y);
+        for (int k = 0; k < ty.count; k++) {
+            decodeRow(src + (size_t)(ty.first + k) * width * 4, width, role, rows[k].data());
+        }
+        for (int x = 0; x < w; x++) {
+            MipTaps tx = getMipTaps(width, x);
+            float4 s = splat4(0.0f);
+            for (int k = 0; k < ty.count; k++) {
+                for (int j = 0; j < tx.count; j++) {
+                    float4 texel = load4(&rows[k][(tx.first + j) * 4]);
+                    s = add4(s, mul4(texel, splat4(ty.weights[k] * tx.weights[j])));
+                }
+            }
+            float p[4];
+            store4(p, s);
+            encodePixel(p, role, dst + (y * w + x) * 4);
+        }
+    }
+}
+
+void buildMipChain(Image &image, TextureRole role) {
+    int width = image.width;
+    int height = image.height;
+    const unsigned char *src = image.buffer;
+    while (width > 1 || height > 1) {
+        int w = std::max(width / 2, 1);
+        int h = std::max(height / 2, 1);
+        image.mips.emplace_back(w * h * 4);
+        downsample(src, width, height, image.mips.back().data(), role);
+        src = image.mips.back().data();
+        width = w;
+        height = h;
+    }
+}
+
+int getMipCount(const Image &image) {
+    return image.compressed.empty() ? 1 + image.mips.size() : image.compressed.size();
+}
+
+// The role of every image, from the material slots of the meshes that are drawn; sources maps glTF textures to
+// images. Color wins over everything, an image used for more than occlusion is plain linear data.
+std::vector<TextureRole> getImageRoles(std::vector<Mesh> &meshes, std::vector<int> &sources, size_t count) {
+    std::vector<int> uses(count, 0);
+    auto mark = [&](int texture, TextureRole role) {
+        if (texture >= 0 && texture < (int)sources.size() && sources[texture] >= 0 && sources[texture] < (int)count) {
+            uses[sources[texture]] |= 1 << role;
+        }
+    };
+    for (auto &mesh : meshes) {
+        mark(mesh.material->baseColorTexture, TextureColor);
+        mark(mesh.material->emissiveTexture, TextureColor);
+        mark(mesh.material->normalTexture, TextureNormal);
+        mark(mesh.material->occlusionTexture, TextureOcclusion);
+        mark(mesh.material->metallicRoughnessTexture, TextureLinear);
+    }
+    std::vector<TextureRole> r(count, TextureLinear);
+    for (size_t i = 0; i < count; i++) {
+        for (TextureRole role : {TextureColor, TextureNormal, TextureOcclusion}) {
+            if (uses[i] == 1 << role || (role == TextureColor && uses[i] & 1 << role)) {
+                r[i] = role;
+                break;
+            }
+        }
+    }
+    return r;
+}
+
+void buildMipmaps(ThreadPool &pool, std::vector<Image> &images, const std::vector<TextureRole> &roles) {
+    auto start = std::chrono::steady_clock::now();
+    std::vector<std::future<void>> futures;
+    for (size_t i = 0; i < images.size(); i++) {
+        // KTX2 images may already carry their chain
+        if (images[i].buffer != nullptr && images[i].mips.empty()) {
+            Image *image = &images[i];
+            TextureRole role = roles[i];
+            futures.push_back(pool.submit([image, role] { buildMipChain(*image, role); }));
+        }
+    }
+    for (auto &f : futures) {
+        f.get();
+    }
+    auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start);
+    std::cout << "mipmaps: " << futures.size() << " images in " << ms.count() << " ms" << std::endl;
+}
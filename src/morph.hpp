@@ -0,0 +1,85 @@
+#include <iostream>
+#include <vector>
+
+// Adds weight * target to values (elements of `components` floats). Sparse targets without a bufferView, the
+// usual way morph deltas are stored, are applied straight from their sparse entries without expanding them.
+void blendMorphTarget(std::vector<float> &values,
+                      int components,
+                      Buffer &target,
+                      float weight,
+                      const std::vector<unsigned char> &buffer) {
+    int n = std::min(components, target.components);
+    if (target.offset < 0 && target.data.empty()) {
+        int componentSize = getCount(target.componentType);
+        const unsigned char *p = buffer.data() + target.sparse.valuesOffset;
+        std::vector<uint32_t> indices = readSparseIndices(target, buffer);
+        for (int i = 0; i < target.sparse.count; i++) {
+            if (indices[i] >= values.size() / components) {
+                continue;
+            }
+            for (int c = 0; c < n; c++) {
+                float v = readComponent(p + (i * target.components + c) * componentSize,
+                                        target.componentType,
+                                        target.normalized);
+                values[indices[i] * components + c] += weight * v;
+            }
+        }
+        return;
+    }
+    std::vector<float> dense = readFloats(target, buffer);
+    for (size_t i = 0; i < values.size() / components && i < (size_t)target.count; i++) {
+        for (int c = 0; c < n; c++) {
+            values[i * components + c] += weight * dense[i * target.components + c];
+        }
+    }
+}
+
+// Bakes the default mesh weights into POSITION, NORMAL and TANGENT. The blended streams are new accessors,
+// the base ones may be shared with other meshes.
+void applyMorphTargets(json &data,
+                       std::vector<Mesh> &meshes,
+                       std::vector<Buffer> &geometries,
+                       const std::vector<unsigned char> &buffer) {
+    int blended = 0;
+    for (size_t i = 0; i < meshes.size(); i++) {
+        json &mesh = data["meshes"][meshes[i].meshIndex];
+        json primitive = mesh["primitives"][0];
+        if (!primitive.contains("targets") || !mesh.contains("weights")) {
+            continue;
+        }
+        std::vector<float> weights = mesh["weights"];
+        Geometry *g = meshes[i].geometry;
+        std::vector<std::pair<std::string, int *>> attributes{
+            {"POSITION", &g->position}, {"NORMAL", &g->normal}, {"TANGENT", &g->tangent}};
+        for (auto &[name, attribute] : attributes) {
+            if (*attribute == -1) {
+                continue;
+            }
+            Buffer &base = geometries[*attribute];
+            std::vector<float> values;
+            for (size_t t = 0; t < primitive["targets"].size() && t < weights.size(); t++) {
+                json target = primitive["targets"][t];
+                if (weights[t] == 0.0f || !target.contains(name)) {
+                    continue;
+                }
+                if (values.empty()) {
+                    values = readFloats(base, buffer);
+                }
+                blendMorphTarget(values, base.components, geometries[(int)target[name]], weights[t], buffer);
+            }
+            if (values.empty()) {
+                continue;
+            }
+            Buffer b{0, (int)(values.size() * sizeof(float)), base.count, 4, 0};
+            b.components = base.components;
+            b.data.resize(b.length);
+            memcpy(b.data.data(), values.data(), b.length);
+            geometries.push_back(std::move(b));
+            *attribute = geometries.size() - 1;
+            blended++;
+        }
+    }
+    if (blended > 0) {
+        std::cout << "morph targets: blended " << blended << " attributes" << std::endl;
+    }
+}
@@ -1,3 +1,5 @@
+#include <cstdint>
+#include <mutex>
 #include <vector>
 
 #include <glm/mat4x4.hpp>
@@ -15,12 +17,67 @@ struct CameraData {
     glm::vec3 dir;
 };
 
+struct Sparse {
+    int count = 0;
+    int indicesOffset;
+    int indicesComponentType;
+    int valuesOffset;
+};
+
 struct Buffer {
     int offset;
     int length;
     int count;
     int sizeofComponent;
     int stride;
+    int componentType = 5126;
+    int components = 1;
+    int byteStride = 0;
+    bool normalized = false;
+    bool upload = true;
+    bool indices = false;
+    int baseVertex = 0;
+    // offset is -1 for accessors without a bufferView
+    Sparse sparse;
+    // filled by load-time processing, replaces the range of the glTF buffer when not empty
+    std::vector<unsigned char> data;
+};
+
+// Layout shared with a GPU-driven path, 52 bytes.
+struct Meshlet {
+    uint32_t vertexOffset;   // into Meshlets::vertices
+    uint32_t triangleOffset; // into Meshlets::triangles, 3 local indices per triangle
+    uint32_t vertexCount;
+    uint32_t triangleCount;
+    uint32_t indexOffset; // first index in the source index buffer, meshlets keep the triangle order
+    float center[3];
+    float radius;
+    float coneAxis[3];
+    float coneCutoff;
+};
+
+struct Meshlets {
+    std::vector<Meshlet> meshlets;
+    std::vector<uint32_t> vertices;
+    std::vector<uint8_t> triangles;
+
+    // structure of arrays copy of the bounds for cullMeshlets, padded to a multiple of 4
+    std::vector<float> bounds[8];
+};
+
+// how a texture is sampled decides how it is filtered and stored
+enum TextureRole {
+    TextureLinear,
+    TextureColor,  // sRGB encoded, baseColor and emissive
+    TextureNormal, // tangent space normals
+    TextureOcclusion, // only the red channel is sampled
+};
+
+enum BlockFormat {
+    BlockNone,
+    BlockBC4,
+    BlockBC5,
+    BlockBC7,
 };
 
 struct Image {
@@ -28,6 +85,60 @@ struct Image {
     int height; 
     int channels;
     unsigned char *buffer;
+    std::vector<std::vector<unsigned char>> mips; // RGBA8 levels 1..n, level 0 is buffer
+    BlockFormat format = BlockNone;
+    std::vector<std::vector<unsigned char>> compressed; // all levels, when format is set
+    std::vector<unsigned char> ktx2; // KTX2 container waiting for transcodeImages
+    uint64_t hash[2] = {0, 0};       // content and role, see dedupImages
+    int duplicate = -1;              // image with the same content, this one is left empty
+};
+
+// Low resolution decodes (see decodePreview) handed from the decode jobs to the streamer, which shows them until the
+// image pipeline delivers the real levels.
+struct PreviewQueue {
+    std::mutex mutex;
+    std::vector<std::pair<size_t, Image>> images; // glTF image, RGBA8 level 0
+};
+
+// a glTF sampler with the glTF filter and wrap constants, identical keys share one MTL::SamplerState
+struct SamplerKey {
+    int magFilter = 9729;
+    int minFilter = 9987;
+    int wrapS = 10497;
+    int wrapT = 10497;
+    int anisotropy = 1;
+
+    auto operator<=>(const SamplerKey &) const = default;
+};
+
+struct Quantization {
+    float positionOffset[3];
+    float hasTangent;
+    float positionScale[3];
+    float pad;
+    float uvOffset[2];
+    float uvScale[2];
+};
+
+// how vertexMain reads an attribute, mirrors AttributeFormat in base.metal
+struct AttributeFormat {
+    uint32_t componentType;
+    uint32_t normalized;
+    uint32_t stride;
+    uint32_t components; // 0 when the attribute is missing
+};
+
+struct VertexLayout {
+    AttributeFormat position;
+    AttributeFormat normal;
+    AttributeFormat uv;
+    AttributeFormat tangent;
+};
+
+// simplified index buffer, error is the object space distance it may deviate from the full mesh
+struct Lod {
+    int index;
+    float error;
 };
 
 struct Geometry {
@@ -40,17 +151,47 @@ struct Geometry {
     int normal;
     int uv;
     int tangent;
+    int quantized = -1;
+    Quantization quantization;
+    VertexLayout layout;
+    std::vector<Lod> lods;
+    float center[3];
+    float radius = 0.0f;
+};
+
+// fragment texture slots, also the order of Material::uvTransform
+enum TextureSlot {
+    SlotBaseColor,
+    SlotNormal,
+    SlotMetallicRoughness,
+    SlotEmissive,
+    SlotOcclusion,
+};
+
+// where KHR_texture_transform is applied, see base.metal
+enum UvTransformStage {
+    UvTransformNone,
+    UvTransformVertex,   // every texture shares uvTransform[0]
+    UvTransformFragment, // one transform per texture slot
 };
 
+// mirrors MaterialData in base.metal
 struct Material {
     float baseColor[4]{1.0,1.0,1.0,1.0};
     float roughnessFactor;
     float metallicFactor;
-    int baseColorTexture;
-    int metallicRoughnessTexture;
-    int normalTexture;
+    int baseColorTexture = -1;
+    int metallicRoughnessTexture = -1;
+    int normalTexture = -1;
     int emissiveTexture = -1;
     int occlusionTexture = -1;
+    int uvTransformStage = UvTransformNone;
+    // 3x2 matrix per slot, rows padded to four floats
+    float uvTransform[5][2][4] = {{{1, 0, 0, 0}, {0, 1, 0, 0}},
+                                  {{1, 0, 0, 0}, {0, 1, 0, 0}},
+                                  {{1, 0, 0, 0}, {0, 1, 0, 0}},
+                                  {{1, 0, 0, 0}, {0, 1, 0, 0}},
+                                  {{1, 0, 0, 0}, {0, 1, 0, 0}}};
 
     // Material(std::vector<double> b) : baseColor(b) {}
 };
@@ -58,6 +199,8 @@ struct Material {
 struct Mesh {
     Material *material;
     Geometry *geometry;
+    int materialIndex = -1; // glTF material, shared materials can be batched
+    int meshIndex = -1;     // glTF mesh, meshes are pruned and batched so it is not the position in meshes
 
     Mesh(Geometry *g, Material *m) : material(m), geometry(g) {}
 };
@@ -0,0 +1,66 @@
+#include <condition_variable>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <vector>
+
+// Fixed set of worker threads for load time jobs, submit() returns a future of the job result.
+class ThreadPool {
+public:
+    ThreadPool(unsigned int threads = std::max(1u, std::thread::hardware_concurrency())) {
+        for (unsigned int i = 0; i < threads; i++) {
+            workers.emplace_back([this] { work(); });
+        }
+    }
+
+    ~ThreadPool() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        condition.notify_all();
+        for (auto &worker : workers) {
+            worker.join();
+        }
+    }
+
+    template <typename F>
+    auto submit(F f) -> std::future<decltype(f())> {
+        auto task = std::make_shared<std::packaged_task<decltype(f())()>>(std::move(f));
+        std::future<decltype(f())> r = task->get_future();
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            jobs.push([task] { (*task)(); });
+        }
+        condition.notify_one();
+        return r;
+    }
+
+    size_t size() const { return workers.size(); }
+
+private:
+    void work() {
+        while (true) {
+            std::function<void()> job;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                condition.wait(lock, [this] { return stopping || !jobs.empty(); });
+                if (stopping && jobs.empty()) {
+                    return;
+                }
+                job = std::move(jobs.front());
+                jobs.pop();
+            }
+            job();
+        }
+    }
+
+    std::vector<std::thread> workers;
+    std::queue<std::function<void()>> jobs;
+    std::mutex mutex;
+    std::condition_variable condition;
+    bool stopping = false;
+};
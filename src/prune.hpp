@@ -0,0 +1,178 @@
+#include <algorithm>
+#include <iostream>
+#include <string>
+#include <vector>
+
+// What the active scene actually uses; everything else is neither fetched, decoded nor uploaded.
+struct Reachable {
+    std::vector<bool> nodes;
+    std::vector<bool> meshes;
+    std::vector<bool> materials;
+    std::vector<bool> textures;
+    std::vector<bool> images;
+    std::vector<bool> accessors;
+    std::vector<bool> bufferViews;
+    std::vector<bool> buffers;
+};
+
+void markBufferView(json &data, Reachable &r, int view) {
+    if (view < 0 || view >= (int)r.bufferViews.size() || r.bufferViews[view]) {
+        return;
+    }
+    r.bufferViews[view] = true;
+    json &bufferView = data["bufferViews"][view];
+    r.buffers[(int)bufferView["buffer"]] = true;
+    if (bufferView.contains("extensions") && bufferView["extensions"].contains("EXT_meshopt_compression")) {
+        r.buffers[(int)bufferView["extensions"]["EXT_meshopt_compression"]["buffer"]] = true;
+    }
+}
+
+void markAccessor(json &data, Reachable &r, int accessor) {
+    if (accessor < 0 || accessor >= (int)r.accessors.size() || r.accessors[accessor]) {
+        return;
+    }
+    r.accessors[accessor] = true;
+    json &a = data["accessors"][accessor];
+    markBufferView(data, r, a.value("bufferView", -1));
+    if (a.contains("sparse")) {
+        markBufferView(data, r, a["sparse"]["indices"]["bufferView"]);
+        markBufferView(data, r, a["sparse"]["values"]["bufferView"]);
+    }
+}
+
+// KHR_texture_basisu puts its KTX2 image in the extension, "source" is then an optional fallback
+int getImageIndex(json &data, int texture) {
+    if (texture < 0 || texture >= (int)data["textures"].size()) {
+        return -1;
+    }
+    json &t = data["textures"][texture];
+    int basisu = -1;
+    if (t.contains("extensions") && t["extensions"].contains("KHR_texture_basisu")) {
+        basisu = t["extensions"]["KHR_texture_basisu"].value("source", -1);
+    }
+#ifdef REDCUBE_BASISU
+    if (basisu >= 0) {
+        return basisu;
+    }
+#endif
+    return t.value("source", basisu);
+}
+
+void markTexture(json &data, Reachable &r, json &info) {
+    int texture = info.value("index", -1);
+    if (texture < 0 || texture >= (int)r.textures.size()) {
+        return;
+    }
+    r.textures[texture] = true;
+    int image = getImageIndex(data, texture);
+    if (image >= 0 && image < (int)r.images.size()) {
+        r.images[image] = true;
+    }
+}
+
+// Only the slots buildMesh binds, textures of KHR_materials_* extensions are never sampled. Images are loaded from
+// their uri (see buildImages), so no bufferView is marked for them.
+void markTextures(json &data, Reachable &r, json &material) {
+    if (material.contains("pbrMetallicRoughness")) {
+        json &pbr = material["pbrMetallicRoughness"];
+        for (const char *key : {"baseColorTexture", "metallicRoughnessTexture"}) {
+            if (pbr.contains(key)) {
+                markTexture(data, r, pbr[key]);
+            }
+        }
+    }
+    for (const char *key : {"normalTexture", "occlusionTexture", "emissiveTexture"}) {
+        if (material.contains(key)) {
+            markTexture(data, r, material[key]);
+        }
+    }
+}
+
+Reachable findReachable(json &data) {
+    Reachable r;
+    r.nodes.assign(data["nodes"].size(), false);
+    r.meshes.assign(data["meshes"].size(), false);
+    r.materials.assign(data["materials"].size(), false);
+    r.textures.assign(data["textures"].size(), false);
+    r.images.assign(data["images"].size(), false);
+    r.accessors.assign(data["accessors"].size(), false);
+    r.bufferViews.assign(data["bufferViews"].size(), false);
+    r.buffers.assign(data["buffers"].size(), false);
+
+    std::vector<int> stack;
+    if (data.contains("scenes") && data["scenes"].size() > 0) {
+        int scene = data.value("scene", 0);
+        for (int n : data["scenes"][scene].value("nodes", std::vector<int>())) {
+            stack.push_back(n);
+        }
+    } else {
+        for (size_t n = 0; n < r.nodes.size(); n++) {
+            stack.push_back(n);
+        }
+    }
+    while (!stack.empty()) {
+        int n = stack.back();
+        stack.pop_back();
+        if (n < 0 || n >= (int)r.nodes.size() || r.nodes[n]) {
+            continue;
+        }
+        r.nodes[n] = true;
+        json &node = data["nodes"][n];
+        for (int child : node.value("children", std::vector<int>())) {
+            stack.push_back(child);
+        }
+        int m = node.value("mesh", -1);
+        if (m >= 0 && m < (int)r.meshes.size()) {
+            r.meshes[m] = true;
+        }
+    }
+
+    for (size_t m = 0; m < r.meshes.size(); m++) {
+        if (!r.meshes[m]) {
+            continue;
+        }
+        for (auto &primitive : data["meshes"][m]["primitives"]) {
+            markAccessor(data, r, primitive.value("indices", -1));
+            for (auto &[name, accessor] : primitive["attributes"].items()) {
+                markAccessor(data, r, accessor);
+            }
+            for (auto &target : primitive.value("targets", json::array())) {
+                for (auto &[name, accessor] : target.items()) {
+                    markAccessor(data, r, accessor);
+                }
+            }
+            if (primitive.contains("extensions") && primitive["extensions"].contains("KHR_draco_mesh_compression")) {
+                markBufferView(data, r, primitive["extensions"]["KHR_draco_mesh_compression"]["bufferView"]);
+            }
+            int material = primitive.value("material", -1);
+            if (material >= 0 && material < (int)r.materials.size() && !r.materials[material]) {
+                r.materials[material] = true;
+                markTextures(data, r, data["materials"][material]);
+            }
+        }
+    }
+
+    auto count = [](const std::vector<bool> &v) {
+        return std::to_string(std::count(v.begin(), v.end(), true)) + "/" + std::to_string(v.size());
+    };
+    std::cout << "reachable: " << count(r.meshes) << " meshes, " << count(r.accessors) << " accessors, "
+              << count(r.images) << " images, " << count(r.buffers) << " buffers" << std::endl;
+    return r;
+}
+
+// Drops the meshes the scene never shows, together with their matrix slot.
+void pruneMeshes(std::vector<Mesh> &meshes, std::vector<glm::mat4> &matricies, const std::vector<bool> &reachable) {
+    std::vector<Mesh> keptMeshes;
+    std::vector<glm::mat4> keptMatricies;
+    for (size_t i = 0; i < meshes.size(); i++) {
+        if (i < reachable.size() && !reachable[i]) {
+            continue;
+        }
+        keptMeshes.push_back(meshes[i]);
+        if (i < matricies.size()) {
+            keptMatricies.push_back(matricies[i]);
+        }
+    }
+    meshes = std::move(keptMeshes);
+    matricies = std::move(keptMatricies);
+}
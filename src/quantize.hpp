@@ -0,0 +1,180 @@
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <map>
+#include <vector>
+
+// 20 bytes per vertex instead of 48 for float position, normal, uv and tangent
+struct QuantizedVertex {
+    uint16_t position[4]; // unorm16 relative to the mesh bounds, w keeps the tangent sign
+    int16_t normal[2];    // octahedral snorm16
+    int16_t tangent[2];   // octahedral snorm16
+    uint16_t uv[2];       // unorm16 relative to the uv bounds
+};
+
+int16_t encodeSnorm16(float v) {
+    v = fminf(fmaxf(v, -1.0f), 1.0f);
+    return (int16_t)roundf(v * 32767.0f);
+}
+
+float decodeSnorm16(int16_t v) {
+    return fmaxf(v / 32767.0f, -1.0f);
+}
+
+uint16_t encodeUnorm16(float v, float offset, float scale) {
+    if (scale <= 0.0f) {
+        return 0;
+    }
+    float q = roundf((v - offset) / scale);
+    return (uint16_t)fminf(fmaxf(q, 0.0f), 65535.0f);
+}
+
+void octEncode(const float *n, int16_t *out) {
+    float l = fabsf(n[0]) + fabsf(n[1]) + fabsf(n[2]);
+    float x = l > 0.0f ? n[0] / l : 0.0f;
+    float y = l > 0.0f ? n[1] / l : 0.0f;
+    if (n[2] < 0.0f) {
+        float ox = x;
+        float oy = y;
+        x = (1.0f - fabsf(oy)) * (ox >= 0.0f ? 1.0f : -1.0f);
+        y = (1.0f - fabsf(ox)) * (oy >= 0.0f ? 1.0f : -1.0f);
+    }
+    out[0] = encodeSnorm16(x);
+    out[1] = encodeSnorm16(y);
+}
+
+void octDecode(const int16_t *in, float *n) {
+    float x = decodeSnorm16(in[0]);
+    float y = decodeSnorm16(in[1]);
+    float z = 1.0f - fabsf(x) - fabsf(y);
+    float t = fmaxf(-z, 0.0f);
+    x += x >= 0.0f ? -t : t;
+    y += y >= 0.0f ? -t : t;
+    float l = sqrtf(x * x + y * y + z * z);
+    n[0] = x / l;
+    n[1] = y / l;
+    n[2] = z / l;
+}
+
+// CPU reference for vertexQuantized in base.metal
+void decodeVertex(const QuantizedVertex &v,
+                  const Quantization &q,
+                  float *position,
+                  float *normal,
+                  float *uv,
+                  float *tangent) {
+    for (int c = 0; c < 3; c++) {
+        position[c] = q.positionOffset[c] + v.position[c] * q.positionScale[c];
+    }
+    for (int c = 0; c < 2; c++) {
+        uv[c] = q.uvOffset[c] + v.uv[c] * q.uvScale[c];
+    }
+    octDecode(v.normal, normal);
+    octDecode(v.tangent, tangent);
+    tangent[3] = v.position[3] ? 1.0f : -1.0f;
+}
+
+void getBounds(const std::vector<float> &values, int components, float *min, float *max) {
+    for (int c = 0; c < components; c++) {
+        min[c] = INFINITY;
+        max[c] = -INFINITY;
+    }
+    for (size_t i = 0; i < values.size(); i++) {
+        int c = i % components;
+        min[c] = fminf(min[c], values[i]);
+        max[c] = fmaxf(max[c], values[i]);
+    }
+}
+
+std::vector<QuantizedVertex> quantizeVertices(const std::vector<float> &positions,
+                                              const std::vector<float> &normals,
+                                              const std::vector<float> &uvs,
+                                              const std::vector<float> &tangents,
+                                              Quantization &q) {
+    size_t count = positions.size() / 3;
+    float min[3], max[3];
+    getBounds(positions, 3, min, max);
+    for (int c = 0; c < 3; c++) {
+        q.positionOffset[c] = min[c];
+        q.positionScale[c] = (max[c] - min[c]) / 65535.0f;
+    }
+    getBounds(uvs, 2, min, max);
+    for (int c = 0; c < 2; c++) {
+        q.uvOffset[c] = uvs.empty() ? 0.0f : min[c];
+        q.uvScale[c] = uvs.empty() ? 0.0f : (max[c] - min[c]) / 65535.0f;
+    }
+    q.hasTangent = tangents.empty() ? 0.0f : 1.0f;
+    q.pad = 0.0f;
+
+    std::vector<QuantizedVertex> r(count);
+    for (size_t i = 0; i < count; i++) {
+        QuantizedVertex &v = r[i];
+        for (int c = 0; c < 3; c++) {
+            v.position[c] = encodeUnorm16(positions[i * 3 + c], q.positionOffset[c], q.positionScale[c]);
+        }
+        octEncode(&normals[i * 3], v.normal);
+        v.uv[0] = uvs.empty() ? 0 : encodeUnorm16(uvs[i * 2], q.uvOffset[0], q.uvScale[0]);
+        v.uv[1] = uvs.empty() ? 0 : encodeUnorm16(uvs[i * 2 + 1], q.uvOffset[1], q.uvScale[1]);
+        if (tangents.empty()) {
+            v.tangent[0] = v.tangent[1] = 0;
+            v.position[3] = 1;
+        } else {
+            octEncode(&tangents[i * 4], v.tangent);
+            v.position[3] = tangents[i * 4 + 3] < 0.0f ? 0 : 1;
+        }
+    }
+    return r;
+}
+
+// Replaces the float attribute streams of every mesh with one interleaved QuantizedVertex stream.
+// The source accessors stay in geometries and are only uploaded if something else still uses them.
+void quantizeMeshes(std::vector<Mesh> &meshes,
+                    std::vector<Buffer> &geometries,
+                    const std::vector<unsigned char> &buffer) {
+    std::map<std::array<int, 4>, Geometry *> done;
+    size_t before = 0;
+    size_t after = 0;
+    for (auto &mesh : meshes) {
+        Geometry *g = mesh.geometry;
+        if (geometries[g->position].componentType != 5126) {
+            // already compact (KHR_mesh_quantization), keep it as is
+            continue;
+        }
+        std::array<int, 4> key{g->position, g->normal, g->uv, g->tangent};
+        auto it = done.find(key);
+        if (it != done.end()) {
+            g->quantized = it->second->quantized;
+            g->quantization = it->second->quantization;
+            continue;
+        }
+
+        std::vector<float> positions = readFloats(geometries[g->position], buffer);
+        std::vector<float> normals = readFloats(geometries[g->normal], buffer);
+        std::vector<float> uvs;
+        std::vector<float> tangents;
+        if (g->uv != -1) {
+            uvs = readFloats(geometries[g->uv], buffer);
+        }
+        if (g->tangent != -1) {
+            tangents = readFloats(geometries[g->tangent], buffer);
+        }
+        std::vector<QuantizedVertex> vertices = quantizeVertices(positions, normals, uvs, tangents, g->quantization);
+
+        Buffer b{0, (int)(vertices.size() * sizeof(QuantizedVertex)), (int)vertices.size(), 2, 0};
+        b.componentType = 5123;
+        b.byteStride = sizeof(QuantizedVertex);
+        b.data.resize(b.length);
+        memcpy(b.data.data(), vertices.data(), b.length);
+        geometries.push_back(std::move(b));
+        g->quantized = geometries.size() - 1;
+        done[key] = g;
+
+        before += (positions.size() + normals.size() + uvs.size() + tangents.size()) * sizeof(float);
+        after += vertices.size() * sizeof(QuantizedVertex);
+    }
+    if (before > 0) {
+        std::cout << "quantized vertices: " << before / 1024 << " KB -> " << after / 1024 << " KB" << std::endl;
+    }
+}
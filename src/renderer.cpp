@@ -22,89 +22,214 @@ using json = nlohmann::json;
 #include "renderer.hpp"
 #include "request.hpp"
 #include "utils.hpp"
+#include "simd.hpp"
+#include "meshopt.hpp"
+#include "prune.hpp"
+#include "ktx2.hpp"
+#include "decoders.hpp"
 #include "creators.hpp"
+#include "accessors.hpp"
+#include "draco.hpp"
+#include "morph.hpp"
+#include "cache.hpp"
+#include "weld.hpp"
+#include "tangents.hpp"
+#include "simplify.hpp"
+#include "quantize.hpp"
+#include "indices.hpp"
+#include "meshlets.hpp"
+#include "batch.hpp"
+#include "mips.hpp"
+#include "bc.hpp"
+#include "channels.hpp"
+#include "dedup.hpp"
+#include "streamer.hpp"
+#include "samplers.hpp"
+#include "ring.hpp"
+
+// managed buffers, written by the CPU and flushed once per frame
+template <>
+struct RingTraits<MTL::Device, MTL::Buffer> {
+    static MTL::Buffer *newBuffer(MTL::Device *pDevice, size_t size) {
+        return pDevice->newBuffer(size, MTL::ResourceStorageModeManaged);
+    }
+    static void flush(MTL::Buffer *pBuffer, size_t length) {
+        pBuffer->didModifyRange(NS::Range::Make(0, length));
+    }
+};
 
 const int Renderer::kMaxFramesInFlight = 3;
 
 std::vector<MTL::Buffer *> Renderer::buildBuffers(MTL::Device *_pDevice,
                                                   std::vector<Buffer> &geometries,
                                                   std::vector<unsigned char> &buffer) {
-    std::vector<MTL::Buffer *> r;
     for (auto &g : geometries) {
-        if (g.sizeofComponent == 1) {
-            std::vector<unsigned char> temp(g.length * 2);
-            unsigned char* b = buffer.data() + g.offset;
-            int j = 0;
-            for (int i = 0; i < temp.size(); i+=2) {
-                temp[i] =  b[j];
-                j++;
+        g.upload = false;
+    }
+    for (auto &mesh : meshes) {
+        Geometry *g = mesh.geometry;
+        geometries[g->index].upload = true;
+        for (const Lod &lod : g->lods) {
+            geometries[lod.index].upload = true;
+        }
+        if (g->quantized != -1) {
+            geometries[g->quantized].upload = true;
+            continue;
+        }
+        for (int a : {g->position, g->normal, g->uv, g->tangent}) {
+            if (a != -1) {
+                geometries[a].upload = true;
             }
+        }
+    }
 
-            MTL::Buffer *VertexBuffer = _pDevice->newBuffer(g.length * 2, MTL::ResourceStorageModeManaged);
-            memcpy(VertexBuffer->contents(), temp.data(), g.length * 2);
-            VertexBuffer->didModifyRange(NS::Range::Make(0, VertexBuffer->length()));
-            r.push_back(VertexBuffer);
+    std::vector<MTL::Buffer *> r;
+    for (auto &g : geometries) {
+        if (!g.upload) {
+            r.push_back(nullptr);
+        } else if (g.indices) {
+            MTL::Buffer *IndexBuffer = _pDevice->newBuffer(g.count * g.sizeofComponent, MTL::ResourceStorageModeManaged);
+            writeIndices(g, buffer, IndexBuffer->contents());
+            IndexBuffer->didModifyRange(NS::Range::Make(0, IndexBuffer->length()));
+            r.push_back(IndexBuffer);
         } else {
-            MTL::Buffer *VertexBuffer = _pDevice->newBuffer(g.length, MTL::ResourceStorageModeManaged);
-            memcpy(VertexBuffer->contents(), buffer.data() + g.offset, g.length);
+            const unsigned char *data = getData(g, buffer);
+            int length = g.data.empty() ? g.length : g.data.size();
+            MTL::Buffer *VertexBuffer = _pDevice->newBuffer(length, MTL::ResourceStorageModeManaged);
+            memcpy(VertexBuffer->contents(), data, length);
             VertexBuffer->didModifyRange(NS::Range::Make(0, VertexBuffer->length()));
             r.push_back(VertexBuffer);
         }
     }
 
+    // after the upload, materialized accessors are tightly packed
     for (auto &mesh : meshes) {
-        int size = sizeof(Material) - 12;
-        UniformBuffer = _pDevice->newBuffer(size, MTL::ResourceStorageModeManaged);
-        memcpy(UniformBuffer->contents(), mesh.material, size);
+        mesh.geometry->layout = getVertexLayout(*mesh.geometry, geometries);
+    }
+
+    for (auto &mesh : meshes) {
+        // MaterialData in the shader is padded to 16 bytes
+        UniformBuffer = _pDevice->newBuffer((sizeof(Material) + 15) & ~15, MTL::ResourceStorageModeManaged);
+        memcpy(UniformBuffer->contents(), mesh.material, sizeof(Material));
         UniformBuffer->didModifyRange(NS::Range::Make(0, UniformBuffer->length()));
         uniforms.push_back(UniformBuffer);
     }
 
+    // meshlet descriptors, vertex remap and local triangles for a GPU-driven path
+    for (auto &c : clusters) {
+        std::array<std::pair<const void *, size_t>, 3> data{
+            std::make_pair(c.meshlets.data(), c.meshlets.size() * sizeof(Meshlet)),
+            std::make_pair(c.vertices.data(), c.vertices.size() * sizeof(uint32_t)),
+            std::make_pair(c.triangles.data(), c.triangles.size())};
+        for (auto &[p, size] : data) {
+            MTL::Buffer *ClusterBuffer = _pDevice->newBuffer(std::max<size_t>(size, 4), MTL::ResourceStorageModeManaged);
+            memcpy(ClusterBuffer->contents(), p, size);
+            ClusterBuffer->didModifyRange(NS::Range::Make(0, ClusterBuffer->length()));
+            clusterBuffers.push_back(ClusterBuffer);
+        }
+    }
+
     return r;
 };
 
-Renderer::Renderer(MTL::Device *pDevice) : _pDevice(pDevice->retain()) {
+Renderer::Renderer(MTL::Device *pDevice) : _pDevice(pDevice->retain()), _angle(0.0f), _frame(0) {
     json data = getEntry();
-    std::vector<unsigned char> buffer = getBuffer(data);
-
-    std::vector<Image> images = buildImages(data);
-    auto [center, b] = buildGeometry(data, buffer, geometries);
+    Reachable reachable = findReachable(data);
+    std::vector<unsigned char> buffer = getBuffer(pool, data, reachable);
+
+    buildGeometry(data, buffer, geometries);
+    DracoStats dracoStats;
+    std::vector<std::future<void>> draco = decodeDraco(pool, data, geometries, buffer, reachable.meshes, dracoStats);
+    // images load in the background, the first frames render with placeholders (see streamer.hpp)
+    std::future<std::vector<Image>> loading =
+        std::async(std::launch::async, [this, d = json{{"images", data["images"]}}, r = reachable.images]() mutable {
+            return buildImages(pool, d, r, &previews);
+        });
+    for (auto &f : draco) {
+        f.get();
+    }
+    printDracoStats(dracoStats);
+    buildNode(data, matricies);
+    auto [center, b] = buildBounds(data, matricies, reachable.meshes);
     modelSize = b;
-    buildNode(data, matricies, center);
     buildMesh(data, meshes, geometries);
-    buildTexture(images);
+    pruneMeshes(meshes, matricies, reachable.meshes);
+    applyMorphTargets(data, meshes, geometries, buffer);
+    if (WELD_VERTICES) {
+        weldMeshes(pool, meshes, geometries, buffer, WELD_EPSILON);
+    }
+    buildTangents(pool, meshes, geometries, buffer);
+    if (BUILD_LODS) {
+        buildLods(pool, meshes, geometries, buffer);
+    }
+    if (BATCH_STATIC) {
+        clusters = batchMeshes(meshes, matricies, geometries, buffer);
+    }
+    buildBoundingSpheres(meshes, geometries, buffer);
+    if (QUANTIZE_VERTICES) {
+        quantizeMeshes(meshes, geometries, buffer);
+    }
+    compactIndices(meshes, geometries, buffer);
+    if (BUILD_MESHLETS) {
+        clusters = buildClusters(meshes, geometries, buffer, clusters);
+    }
+    std::vector<int> sources;
+    for (size_t t = 0; t < data["textures"].size(); t++) {
+        sources.push_back(getImageIndex(data, t));
+    }
+    std::vector<SamplerKey> samplerKeys = getSamplerKeys(data);
+    std::vector<OrmPack> packs = planOrmPacks(data, meshes, sources, samplerKeys);
+    samplers = buildSamplers(_pDevice, samplerKeys, samplerCache);
+    size_t imageCount = data["images"].size() + packs.size();
+    std::vector<bool> used = getUsedImages(meshes, sources, imageCount);
+    std::vector<TextureRole> roles = getImageRoles(meshes, sources, imageCount);
+    std::future<std::vector<Image>> images =
+        std::async(std::launch::async, [this, loading = std::move(loading), packs, used, roles]() mutable {
+            std::vector<Image> images = loading.get();
+            packOrm(pool, images, packs, used);
+            dedupImages(pool, images, roles);
+            transcodeImages(pool, images, roles);
+            buildMipmaps(pool, images, roles);
+            if (COMPRESS_TEXTURES && _pDevice->supportsBCTextureCompression()) {
+                compressImages(pool, images, roles);
+            }
+            reduceChannels(pool, images, roles);
+            return images;
+        });
+    buildTexture(images, sources, roles);
     buildShaders();
     buffers = buildBuffers(_pDevice, geometries, buffer);
     _pCommandQueue = _pDevice->newCommandQueue();
     buildDepthStencilStates();
 
-    buildFrameData();
+    // room for every draw's CameraData, grown on demand (see ring.hpp)
+    ring = new FrameRing<MTL::Device, MTL::Buffer>(_pDevice, meshes.size() * ((sizeof(CameraData) + 255) & ~255),
+                                                   kMaxFramesInFlight);
     _semaphore = dispatch_semaphore_create(Renderer::kMaxFramesInFlight);
 }
 
-void Renderer::buildTexture(std::vector<Image> &images) {
-    std::vector<int> srgb;
-    for (auto &mesh : meshes) {
-        srgb.push_back(mesh.material->baseColorTexture);
-        srgb.push_back(mesh.material->emissiveTexture);
+// Textures are created by the streamer as images arrive; `sources` maps glTF textures to images.
+void Renderer::buildTexture(std::future<std::vector<Image>> &images,
+                            std::vector<int> &sources,
+                            std::vector<TextureRole> &roles) {
+    streamer =
+        new TextureStreamer(_pDevice, pool, sources, roles, std::move(images), &previews, kMaxFramesInFlight);
+    if (!STREAM_TEXTURES) {
+        streamer->finish();
     }
-    int i = 0;
-    for (auto &image : images) {
-        bool hassrbg = std::find(srgb.begin(), srgb.end(), i) != srgb.end();
-        MTL::TextureDescriptor *pTextureDesc = MTL::TextureDescriptor::alloc()->init();
-        pTextureDesc->setWidth(image.width);
-        pTextureDesc->setHeight(image.height);
-        pTextureDesc->setPixelFormat(hassrbg ? MTL::PixelFormatRGBA8Unorm_sRGB : MTL::PixelFormatRGBA8Unorm);
-        pTextureDesc->setTextureType(MTL::TextureType2D);
-        pTextureDesc->setStorageMode(MTL::StorageModeManaged);
-        pTextureDesc->setUsage(MTL::ResourceUsageSample | MTL::ResourceUsageRead);
 
-        MTL::Texture *pTexture = _pDevice->newTexture(pTextureDesc);
-
-        pTexture->replaceRegion(MTL::Region(0, 0, 0, image.width, image.height, 1), 0, image.buffer, image.width * 4);
-
-        textures.push_back(pTexture);
-        i++;
+    // a texture without an image is treated as absent by the shader, images that fail to decode keep the placeholder
+    for (auto &mesh : meshes) {
+        Material *m = mesh.material;
+        for (int *texture : {&m->baseColorTexture,
+                             &m->metallicRoughnessTexture,
+                             &m->normalTexture,
+                             &m->emissiveTexture,
+                             &m->occlusionTexture}) {
+            if (*texture >= (int)sources.size() || (*texture >= 0 && sources[*texture] < 0)) {
+                *texture = -1;
+            }
+        }
     }
 }
 
@@ -122,8 +247,20 @@ void Renderer::buildShaders() {
         assert(false);
     }
 
-    MTL::Function *pVertexFn = pLibrary->newFunction(NS::String::string("vertexMain", UTF8StringEncoding));
-    MTL::Function *pFragFn = pLibrary->newFunction(NS::String::string("fragmentMain", UTF8StringEncoding));
+    _pPSO = buildPipeline(pLibrary, "vertexMain", "fragmentMain");
+    _pQuantizedPSO = buildPipeline(pLibrary, "vertexQuantized", "fragmentMain");
+
+    pLibrary->release();
+};
+
+MTL::RenderPipelineState *Renderer::buildPipeline(MTL::Library *pLibrary,
+                                                  const char *vertexName,
+                                                  const char *fragmentName) {
+    using NS::StringEncoding::UTF8StringEncoding;
+
+    NS::Error *pError = nullptr;
+    MTL::Function *pVertexFn = pLibrary->newFunction(NS::String::string(vertexName, UTF8StringEncoding));
+    MTL::Function *pFragFn = pLibrary->newFunction(NS::String::string(fragmentName, UTF8StringEncoding));
 
     MTL::RenderPipelineDescriptor *pDesc = MTL::RenderPipelineDescriptor::alloc()->init();
     pDesc->setVertexFunction(pVertexFn);
@@ -134,8 +271,8 @@ void Renderer::buildShaders() {
     pDesc->colorAttachments()->object(0)->setDestinationRGBBlendFactor(MTL::BlendFactor::BlendFactorOneMinusSourceAlpha);
     pDesc->colorAttachments()->object(0)->setRgbBlendOperation(MTL::BlendOperation::BlendOperationAdd);
 
-    _pPSO = _pDevice->newRenderPipelineState(pDesc, &pError);
-    if (!_pPSO) {
+    MTL::RenderPipelineState *pPSO = _pDevice->newRenderPipelineState(pDesc, &pError);
+    if (!pPSO) {
         __builtin_printf("%s", pError->localizedDescription()->utf8String());
         assert(false);
     }
@@ -143,20 +280,19 @@ void Renderer::buildShaders() {
     pVertexFn->release();
     pFragFn->release();
     pDesc->release();
-    pLibrary->release();
-};
+    return pPSO;
+}
 
 Renderer::~Renderer() {
+    delete streamer;
+    delete ring;
+    for (auto &[key, pState] : samplerCache) {
+        pState->release();
+    }
     _pCommandQueue->release();
     _pDevice->release();
 }
 
-void Renderer::buildFrameData() {
-    for (int i = 0; i < Renderer::kMaxFramesInFlight; ++i) {
-        _pFrameData[i] = _pDevice->newBuffer(sizeof(FrameData), MTL::ResourceStorageModeManaged);
-    }
-}
-
 void Renderer::buildDepthStencilStates() {
     MTL::DepthStencilDescriptor *pDsDesc = MTL::DepthStencilDescriptor::alloc()->init();
     pDsDesc->setDepthCompareFunction(MTL::CompareFunction::CompareFunctionLess);
@@ -172,7 +308,6 @@ void Renderer::draw(MTK::View *pView) {
 
     ///
     _frame = (_frame + 1) % Renderer::kMaxFramesInFlight;
-    MTL::Buffer *pFrameDataBuffer = _pFrameData[_frame];
 
     MTL::CommandBuffer *pCmd = _pCommandQueue->commandBuffer();
     dispatch_semaphore_wait(_semaphore, DISPATCH_TIME_FOREVER);
@@ -181,8 +316,10 @@ void Renderer::draw(MTK::View *pView) {
       dispatch_semaphore_signal(pRenderer->_semaphore);
     });
 
-    reinterpret_cast<FrameData *>(pFrameDataBuffer->contents())->angle = (_angle += 0.01f);
-    pFrameDataBuffer->didModifyRange(NS::Range::Make(0, sizeof(FrameData)));
+    streamer->update(pCmd, STREAM_BUDGET, TEXTURE_GPU_BUDGET, TEXTURE_CPU_BUDGET);
+    ring->begin(_frame);
+
+    FrameData frameData{_angle += 0.01f};
     ///
 
     MTL::RenderPassDescriptor *pRpd = pView->currentRenderPassDescriptor();
@@ -191,45 +328,98 @@ void Renderer::draw(MTK::View *pView) {
     int i = 0;
     for (auto &mesh : meshes) {
         CameraData cameraData = camera(modelSize, glm::vec3{0, _angle += 0.0001f, 0}, matricies[i]);
-        UniformBuffer = _pDevice->newBuffer(sizeof(cameraData), MTL::ResourceStorageModeManaged);
-        memcpy(UniformBuffer->contents(), &cameraData, sizeof(CameraData));
-        UniformBuffer->didModifyRange(NS::Range::Make(0, UniformBuffer->length()));
+        // one copy in the frame's ring region serves both stages
+        auto constants = ring->push(cameraData);
 
         pEnc->setCullMode(MTL::CullMode::CullModeNone);
         pEnc->setFrontFacingWinding(MTL::Winding::WindingCounterClockwise);
         pEnc->setDepthStencilState(_pDepthStencilState);
-        pEnc->setRenderPipelineState(_pPSO);
-        pEnc->setVertexBuffer(buffers[mesh.geometry->position], 0, geometries[mesh.geometry->position].stride, 0);
-        pEnc->setVertexBuffer(buffers[mesh.geometry->normal], 0, 1);
-        pEnc->setVertexBuffer(buffers[mesh.geometry->uv], 0, 4);
-        if (mesh.geometry->tangent != -1) {
-            pEnc->setVertexBuffer(buffers[mesh.geometry->tangent], 0, 5);
+        if (mesh.geometry->quantized != -1) {
+            pEnc->setRenderPipelineState(_pQuantizedPSO);
+            pEnc->setVertexBuffer(buffers[mesh.geometry->quantized], 0, 0);
+            pEnc->setVertexBytes(&mesh.geometry->quantization, sizeof(Quantization), 6);
+        } else {
+            pEnc->setRenderPipelineState(_pPSO);
+            pEnc->setVertexBuffer(buffers[mesh.geometry->position], 0, geometries[mesh.geometry->position].stride, 0);
+            pEnc->setVertexBuffer(buffers[mesh.geometry->normal], 0, 1);
+            pEnc->setVertexBuffer(buffers[mesh.geometry->uv], 0, 4);
+            if (mesh.geometry->tangent != -1) {
+                pEnc->setVertexBuffer(buffers[mesh.geometry->tangent], 0, 5);
+            }
+            pEnc->setVertexBytes(&mesh.geometry->layout, sizeof(VertexLayout), 6);
         }
 
-        pEnc->setVertexBuffer(pFrameDataBuffer, 0, 2);
-        pEnc->setVertexBuffer(UniformBuffer, 0, 3);
-        pEnc->setFragmentBuffer(UniformBuffer, 0, 0);
+        pEnc->setVertexBytes(&frameData, sizeof(FrameData), 2);
+        pEnc->setVertexBuffer(constants.buffer, constants.offset, 3);
+        pEnc->setVertexBuffer(uniforms[i], 0, 7);
+        pEnc->setFragmentBuffer(constants.buffer, constants.offset, 0);
         pEnc->setFragmentBuffer(uniforms[i], 0, 1);
-        pEnc->setFragmentTexture(textures[mesh.material->baseColorTexture], 0);
-        pEnc->setFragmentTexture(textures[mesh.material->normalTexture], 1);
-        pEnc->setFragmentTexture(textures[mesh.material->metallicRoughnessTexture], 2);
-        if (mesh.material->emissiveTexture != -1) {
-            pEnc->setFragmentTexture(textures[mesh.material->emissiveTexture], 3);
-        }
-        if (mesh.material->occlusionTexture != -1) {
-            pEnc->setFragmentTexture(textures[mesh.material->occlusionTexture], 4);
+        // the projected bounding sphere stands in for the screen size of the textures
+        float scale;
+        float pixelsPerUnit =
+            getPixelsPerUnit(*mesh.geometry, cameraData.Model, cameraData.dir, pView->drawableSize().height, scale);
+        float pixels = 2.0f * mesh.geometry->radius * scale * pixelsPerUnit;
+        int slots[5] = {mesh.material->baseColorTexture,
+                        mesh.material->normalTexture,
+                        mesh.material->metallicRoughnessTexture,
+                        mesh.material->emissiveTexture,
+                        mesh.material->occlusionTexture};
+        for (int slot = 0; slot < 5; slot++) {
+            if (slots[slot] != -1) {
+                streamer->request(slots[slot], pixels);
+                pEnc->setFragmentTexture(streamer->getTexture(slots[slot], slot), slot);
+                pEnc->setFragmentSamplerState(samplers[slots[slot]], slot);
+            }
         }
         // pEnc->drawPrimitives( MTL::PrimitiveType::PrimitiveTypeTriangle, NS::UInteger(0), NS::UInteger(3) );
-        pEnc->drawIndexedPrimitives(MTL::PrimitiveType::PrimitiveTypeTriangle,
-                                    geometries[mesh.geometry->index].count,
-                                    geometries[mesh.geometry->index].sizeofComponent == 4
-                                        ? MTL::IndexType::IndexTypeUInt32
-                                        : MTL::IndexType::IndexTypeUInt16,
-                                    buffers[mesh.geometry->index],
-                                    0);
+        // meshlets and batch ranges only exist for the full detail index buffer
+        bool ranges = !clusters.empty() && !clusters[i].meshlets.empty();
+        int index = mesh.geometry->index;
+        if (!ranges) {
+            index = selectLod(
+                *mesh.geometry, cameraData.Model, cameraData.dir, pView->drawableSize().height, LOD_PIXEL_ERROR);
+        }
+        Buffer &indices = geometries[index];
+        MTL::IndexType indexType =
+            indices.sizeofComponent == 4 ? MTL::IndexType::IndexTypeUInt32 : MTL::IndexType::IndexTypeUInt16;
+        if (!ranges) {
+            pEnc->drawIndexedPrimitives(MTL::PrimitiveType::PrimitiveTypeTriangle,
+                                        indices.count,
+                                        indexType,
+                                        buffers[index],
+                                        0,
+                                        1,
+                                        indices.baseVertex,
+                                        0);
+        } else {
+            // meshlets are contiguous index ranges, merge neighbours into one draw;
+            // no cone test since everything is drawn with CullModeNone
+            float planes[6][4];
+            getFrustumPlanes(cameraData.Projection * cameraData.View * cameraData.Model, planes);
+            glm::vec4 eye = glm::inverse(cameraData.Model) * glm::vec4(cameraData.dir, 1.0f);
+            std::vector<uint32_t> visible = cullMeshlets(clusters[i], planes, &eye.x, false);
+            std::vector<Meshlet> &m = clusters[i].meshlets;
+            for (size_t k = 0; k < visible.size();) {
+                uint32_t first = m[visible[k]].indexOffset;
+                uint32_t count = 0;
+                uint32_t next = visible[k];
+                for (; k < visible.size() && visible[k] == next; k++, next++) {
+                    count += m[visible[k]].triangleCount * 3;
+                }
+                pEnc->drawIndexedPrimitives(MTL::PrimitiveType::PrimitiveTypeTriangle,
+                                            count,
+                                            indexType,
+                                            buffers[mesh.geometry->index],
+                                            first * indices.sizeofComponent,
+                                            1,
+                                            indices.baseVertex,
+                                            0);
+            }
+        }
         i++;
     }
     pEnc->endEncoding();
+    ring->end();
     pCmd->presentDrawable(pView->currentDrawable());
     pCmd->commit();
 
@@ -1,7 +1,16 @@
 #include <Metal/Metal.hpp>
 #include <MetalKit/MetalKit.hpp>
+#include <map>
 
 #include "objects.hpp"
+#include "pool.hpp"
+
+class TextureStreamer;
+template <typename Device, typename Buffer>
+class FrameRing;
+
+// decodes every image of dir with each available decoder and prints their throughput, see decoders.hpp
+int benchDecoders(const char *dir);
 
 class Renderer {
 public:
@@ -9,28 +18,35 @@ public:
     ~Renderer();
     void draw(MTK::View *pView);
     void buildShaders();
-    void buildFrameData();
-    void buildTexture(std::vector<Image>&);
+    MTL::RenderPipelineState *buildPipeline(MTL::Library *pLibrary, const char *vertexName, const char *fragmentName);
+    void buildTexture(std::future<std::vector<Image>>&, std::vector<int>&, std::vector<TextureRole>&);
     void buildDepthStencilStates();
     std::vector<MTL::Buffer *> buildBuffers(MTL::Device*,
                                             std::vector<Buffer>&,
                                             std::vector<unsigned char>&);
 
 private:
+    ThreadPool pool;
     std::vector<Buffer> geometries;
     MTL::Device *_pDevice;
     MTL::CommandQueue *_pCommandQueue;
     MTL::DepthStencilState *_pDepthStencilState;
     MTL::RenderPipelineState *_pPSO;
+    MTL::RenderPipelineState *_pQuantizedPSO;
     std::vector<MTL::Buffer *> buffers;
     std::vector<MTL::Buffer *> uniforms;
     MTL::Buffer *UniformBuffer;
     std::vector<Mesh> meshes;
+    std::vector<Meshlets> clusters;
+    std::vector<MTL::Buffer *> clusterBuffers;
     std::vector<glm::mat4> matricies;
-    std::vector<MTL::Texture *> textures;
+    TextureStreamer *streamer;
+    PreviewQueue previews;
+    std::map<SamplerKey, MTL::SamplerState *> samplerCache;
+    std::vector<MTL::SamplerState *> samplers; // per glTF texture
     float modelSize;
 
-    MTL::Buffer *_pFrameData[3];
+    FrameRing<MTL::Device, MTL::Buffer> *ring;
     float _angle;
     int _frame;
     dispatch_semaphore_t _semaphore;
@@ -0,0 +1,119 @@
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+#include <vector>
+
+struct RingStats {
+    size_t capacity = 0; // bytes per frame region
+    size_t used = 0;     // last frame
+    size_t peak = 0;
+    int overflows = 0; // allocations that did not fit their region
+    int grows = 0;     // regions reallocated larger
+};
+
+// Transient per frame constants. Each frame in flight owns a region that allocate() bumps through; the region is
+// reused once the frame's command buffer completed, so steady state frames allocate nothing. A frame that outgrows
+// its region chains an extra buffer, and the regions are reallocated larger the next time their frame comes round.
+// Buffers need contents, length and release; creating and flushing them goes through RingTraits, which renderer.cpp
+// specialises for Metal so this header builds without metal-cpp.
+template <typename Device, typename Buffer>
+struct RingTraits;
+
+template <typename Device, typename Buffer>
+class FrameRing {
+public:
+    struct Allocation {
+        Buffer *buffer;
+        size_t offset;
+        void *data;
+    };
+
+    FrameRing(Device *pDevice, size_t capacity, int frames) : _pDevice(pDevice), regions(frames) {
+        stats.capacity = std::max<size_t>(capacity, kAlignment);
+        for (auto &r : regions) {
+            r.buffers.push_back(newBuffer(stats.capacity));
+        }
+    }
+
+    ~FrameRing() {
+        for (auto &r : regions) {
+            for (Buffer *b : r.buffers) {
+                b->release();
+            }
+        }
+    }
+
+    // the frame's previous use has completed on the GPU
+    void begin(int frame) {
+        current = &regions[frame];
+        Region &r = *current;
+        if (r.buffers.size() > 1 || r.buffers[0]->length() < stats.capacity) {
+            for (Buffer *b : r.buffers) {
+                b->release();
+            }
+            r.buffers.assign(1, newBuffer(stats.capacity));
+        }
+        r.offset = 0;
+        r.used = 0;
+    }
+
+    // alignment is the largest constant buffer offset alignment Metal asks for on macOS
+    Allocation allocate(size_t size, size_t alignment = kAlignment) {
+        Region &r = *current;
+        size_t offset = (r.offset + alignment - 1) & ~(alignment - 1);
+        if (offset + size > r.buffers.back()->length()) {
+            RingTraits<Device, Buffer>::flush(r.buffers.back(), r.offset);
+            r.buffers.push_back(newBuffer(std::max(size, stats.capacity)));
+            stats.overflows++;
+            offset = 0;
+        }
+        // as if the frame had fit one buffer, so a grown region holds it
+        r.used = ((r.used + alignment - 1) & ~(alignment - 1)) + size;
+        r.offset = offset + size;
+        stats.used = r.used;
+        stats.peak = std::max(stats.peak, r.used);
+        Buffer *b = r.buffers.back();
+        return Allocation{b, offset, (unsigned char *)b->contents() + offset};
+    }
+
+    template <typename T>
+    Allocation push(const T &value) {
+        Allocation a = allocate(sizeof(T));
+        memcpy(a.data, &value, sizeof(T));
+        return a;
+    }
+
+    // makes the frame's writes visible to the GPU, before the command buffer is committed. A frame that overflowed
+    // grows the regions, geometrically so that stays rare; each is rebuilt when its frame begins.
+    void end() {
+        if (current->offset > 0) {
+            RingTraits<Device, Buffer>::flush(current->buffers.back(), current->offset);
+        }
+        if (current->used > stats.capacity) {
+            stats.capacity = std::max(stats.capacity * 2, (current->used + kAlignment - 1) & ~(kAlignment - 1));
+            stats.grows++;
+            std::cout << "ring: frame regions grow to " << (stats.capacity >> 10) << " KB" << std::endl;
+        }
+    }
+
+    RingStats getStats() const {
+        return stats;
+    }
+
+private:
+    struct Region {
+        std::vector<Buffer *> buffers; // the region, then overflow buffers of this frame
+        size_t offset = 0;             // in the last buffer
+        size_t used = 0;
+    };
+    static constexpr size_t kAlignment = 256;
+
+    Buffer *newBuffer(size_t size) {
+        return RingTraits<Device, Buffer>::newBuffer(_pDevice, size);
+    }
+
+    Device *_pDevice;
+    std::vector<Region> regions;
+    Region *current = nullptr;
+    RingStats stats;
+};
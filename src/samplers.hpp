@@ -0,0 +1,71 @@
+#include <iostream>
+#include <map>
+#include <vector>
+
+// Sampler of every glTF texture. Undefined filters get trilinear filtering, mipmapped linear minification also gets
+// MAX_ANISOTROPY.
+std::vector<SamplerKey> getSamplerKeys(json &data) {
+    std::vector<SamplerKey> r;
+    for (auto &texture : data["textures"]) {
+        SamplerKey key;
+        int sampler = texture.value("sampler", -1);
+        if (sampler >= 0 && sampler < (int)data["samplers"].size()) {
+            json &s = data["samplers"][sampler];
+            key.magFilter = s.value("magFilter", key.magFilter);
+            key.minFilter = s.value("minFilter", key.minFilter);
+            key.wrapS = s.value("wrapS", key.wrapS);
+            key.wrapT = s.value("wrapT", key.wrapT);
+        }
+        if (key.minFilter == 9985 || key.minFilter == 9987) {
+            key.anisotropy = MAX_ANISOTROPY;
+        }
+        r.push_back(key);
+    }
+    return r;
+}
+
+MTL::SamplerAddressMode getAddressMode(int wrap) {
+    switch (wrap) {
+        case 33071:
+            return MTL::SamplerAddressModeClampToEdge;
+        case 33648:
+            return MTL::SamplerAddressModeMirrorRepeat;
+        default:
+            return MTL::SamplerAddressModeRepeat;
+    }
+}
+
+MTL::SamplerState *buildSamplerState(MTL::Device *pDevice, const SamplerKey &key) {
+    MTL::SamplerDescriptor *pDesc = MTL::SamplerDescriptor::alloc()->init();
+    pDesc->setMagFilter(key.magFilter == 9728 ? MTL::SamplerMinMagFilterNearest : MTL::SamplerMinMagFilterLinear);
+    // NEAREST, LINEAR, NEAREST_MIPMAP_NEAREST, LINEAR_MIPMAP_NEAREST, NEAREST_MIPMAP_LINEAR, LINEAR_MIPMAP_LINEAR
+    bool nearest = key.minFilter == 9728 || key.minFilter == 9984 || key.minFilter == 9986;
+    pDesc->setMinFilter(nearest ? MTL::SamplerMinMagFilterNearest : MTL::SamplerMinMagFilterLinear);
+    if (key.minFilter == 9728 || key.minFilter == 9729) {
+        pDesc->setMipFilter(MTL::SamplerMipFilterNotMipmapped);
+    } else {
+        pDesc->setMipFilter(key.minFilter >= 9986 ? MTL::SamplerMipFilterLinear : MTL::SamplerMipFilterNearest);
+    }
+    pDesc->setSAddressMode(getAddressMode(key.wrapS));
+    pDesc->setTAddressMode(getAddressMode(key.wrapT));
+    pDesc->setMaxAnisotropy(key.anisotropy);
+    MTL::SamplerState *pState = pDevice->newSamplerState(pDesc);
+    pDesc->release();
+    return pState;
+}
+
+// one state per distinct key, cache owns them
+std::vector<MTL::SamplerState *> buildSamplers(MTL::Device *pDevice,
+                                               const std::vector<SamplerKey> &keys,
+                                               std::map<SamplerKey, MTL::SamplerState *> &cache) {
+    std::vector<MTL::SamplerState *> r;
+    for (const SamplerKey &key : keys) {
+        auto it = cache.find(key);
+        if (it == cache.end()) {
+            it = cache.emplace(key, buildSamplerState(pDevice, key)).first;
+        }
+        r.push_back(it->second);
+    }
+    std::cout << "samplers: " << keys.size() << " textures, " << cache.size() << " sampler states" << std::endl;
+    return r;
+}
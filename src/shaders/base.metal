@@ -25,13 +25,67 @@ struct CameraData
     float4x4 normal;
     float3 dir;
 };
+struct AttributeFormat
+{
+    uint componentType;
+    uint normalized;
+    uint stride;
+    uint components;
+};
+
+struct VertexLayout
+{
+    AttributeFormat position;
+    AttributeFormat normal;
+    AttributeFormat uv;
+    AttributeFormat tangent;
+};
+
+struct QuantizedVertex
+{
+    packed_ushort4 position;
+    packed_short2 normal;
+    packed_short2 tangent;
+    packed_ushort2 uv;
+};
+
+struct QuantizationData
+{
+    packed_float3 positionOffset;
+    float hasTangent;
+    packed_float3 positionScale;
+    float pad;
+    float2 uvOffset;
+    float2 uvScale;
+};
+
 struct MaterialData
 {
     float4 baseColor;
     float roughnessFactor;
     float metallicFactor;
+    int baseColorTexture;
+    int metallicRoughnessTexture;
+    int normalTexture;
+    int emissiveTexture;
+    int occlusionTexture;
+    int uvTransformStage;
+    // KHR_texture_transform, two float4 rows of a 3x2 matrix per texture slot
+    float4 uvTransform[10];
 };
 
+float2 transformUv(constant MaterialData& material, int slot, float2 uv)
+{
+    float3 p = float3(uv, 1.0);
+    return float2(dot(material.uvTransform[slot * 2].xyz, p), dot(material.uvTransform[slot * 2 + 1].xyz, p));
+}
+
+// a transform shared by all textures was applied once per vertex, otherwise each texture applies its own
+float2 getUv(constant MaterialData& material, int slot, float2 uv)
+{
+    return material.uvTransformStage == 2 ? transformUv(material, slot, uv) : uv;
+}
+
 float pow5(float value) {
     float sq = value*value;
     return sq*sq*value;
@@ -66,28 +120,114 @@ static float TrowbridgeReitzNDF(float NdotH, float roughness)
     return roughnessSq / (M_PI_F * f * f);
 }
 
-v2f vertex vertexMain( device const packed_float3* positions [[buffer(0)]],
-                        device const packed_float3* normals [[buffer(1)]], 
-                        device const packed_float2* uvs [[buffer(4)]], 
-                        device const packed_float4* tangents [[buffer(5)]], 
+float fetchComponent( device const uchar* p, uint componentType, bool normalized )
+{
+    switch (componentType) {
+        case 5120: {
+            float v = float(*(device const char*)p);
+            return normalized ? max(v / 127.0, -1.0) : v;
+        }
+        case 5121: {
+            float v = float(*p);
+            return normalized ? v / 255.0 : v;
+        }
+        case 5122: {
+            float v = float(*(device const short*)p);
+            return normalized ? max(v / 32767.0, -1.0) : v;
+        }
+        case 5123: {
+            float v = float(*(device const ushort*)p);
+            return normalized ? v / 65535.0 : v;
+        }
+        default:
+            return *(device const float*)p;
+    }
+}
+
+// float, int8 and int16 attributes (KHR_mesh_quantization) are read in their stored form
+float4 fetch( device const uchar* data, AttributeFormat format, uint vertexId, float4 fallback )
+{
+    device const uchar* p = data + vertexId * format.stride;
+    uint size = format.componentType == 5126 ? 4 : (format.componentType >= 5122 ? 2 : 1);
+    float4 r = fallback;
+    for (uint c = 0; c < format.components; c++) {
+        r[c] = fetchComponent(p + c * size, format.componentType, format.normalized);
+    }
+    return r;
+}
+
+v2f vertex vertexMain( device const uchar* positions [[buffer(0)]],
+                        device const uchar* normals [[buffer(1)]],
+                        device const uchar* uvs [[buffer(4)]],
+                        device const uchar* tangents [[buffer(5)]],
                         constant FrameData* frameData [[buffer(2)]], 
                         device const CameraData& cameraData [[buffer(3)]],
+                        constant VertexLayout& layout [[buffer(6)]],
+                        constant MaterialData& material [[buffer(7)]],
                         uint vertexId [[vertex_id]] )
 {
+    // the node matrix carries the dequantization of unnormalized positions
+    float3 position = fetch(positions, layout.position, vertexId, float4(0.0)).xyz;
+
     v2f o;
-    o.position = cameraData.projection * cameraData.view * cameraData.model * float4( positions[ vertexId ], 1.0 );
-    o.normal = normals[ vertexId ];
-    o.uv = uvs[ vertexId ];
-    o.pos = cameraData.model * float4( positions[ vertexId ], 1.0 );
+    o.position = cameraData.projection * cameraData.view * cameraData.model * float4( position, 1.0 );
+    o.normal = fetch(normals, layout.normal, vertexId, float4(0.0)).xyz;
+    o.uv = fetch(uvs, layout.uv, vertexId, float4(0.0)).xy;
+    if (material.uvTransformStage == 1) {
+        o.uv = transformUv(material, 0, o.uv);
+    }
+    o.pos = cameraData.model * float4( position, 1.0 );
 
-    float4 inTangent = tangents[ vertexId ];
-    o.normalW = normalize(float3(cameraData.model * float4(o.normal.xyz, 0.0)));
+    float4 inTangent = fetch(tangents, layout.tangent, vertexId, float4(1.0, 0.0, 0.0, 1.0));
+    o.normalW = normalize(float3(cameraData.normal * float4(o.normal.xyz, 0.0)));
     o.tangentW = normalize(float3(cameraData.model * float4(inTangent.xyz, 0.0)));
     o.bitangentW = cross(o.normalW, o.tangentW) * inTangent.w;
 
     return o;
 }
 
+float3 octDecode(short2 e)
+{
+    float2 f = max(float2(e) / 32767.0, -1.0);
+    float3 n = float3(f, 1.0 - abs(f.x) - abs(f.y));
+    float t = saturate(-n.z);
+    n.xy += select(float2(t), float2(-t), n.xy >= 0.0);
+    return normalize(n);
+}
+
+v2f vertex vertexQuantized( device const QuantizedVertex* vertices [[buffer(0)]],
+                            constant FrameData* frameData [[buffer(2)]],
+                            device const CameraData& cameraData [[buffer(3)]],
+                            constant QuantizationData& quantization [[buffer(6)]],
+                            constant MaterialData& material [[buffer(7)]],
+                            uint vertexId [[vertex_id]] )
+{
+    QuantizedVertex v = vertices[ vertexId ];
+    ushort4 q = ushort4(v.position);
+    float3 position = float3(quantization.positionOffset) + float3(q.xyz) * float3(quantization.positionScale);
+
+    v2f o;
+    o.position = cameraData.projection * cameraData.view * cameraData.model * float4( position, 1.0 );
+    o.normal = octDecode(short2(v.normal));
+    o.uv = quantization.uvOffset + float2(ushort2(v.uv)) * quantization.uvScale;
+    if (material.uvTransformStage == 1) {
+        o.uv = transformUv(material, 0, o.uv);
+    }
+    o.pos = cameraData.model * float4( position, 1.0 );
+
+    o.normalW = normalize(float3(cameraData.normal * float4(o.normal.xyz, 0.0)));
+    if (quantization.hasTangent > 0.0) {
+        float3 tangent = octDecode(short2(v.tangent));
+        o.tangentW = normalize(float3(cameraData.model * float4(tangent, 0.0)));
+        o.bitangentW = cross(o.normalW, o.tangentW) * (q.w ? 1.0 : -1.0);
+    } else {
+        o.tangentW = float3(1.0, 0.0, 0.0);
+        o.bitangentW = cross(o.normalW, o.tangentW);
+    }
+
+    return o;
+}
+
 half4 fragment fragmentMain( v2f in [[stage_in]],
                             constant CameraData &uniforms [[buffer(0)]],
                             constant MaterialData &material [[buffer(1)]],
@@ -95,27 +235,41 @@ half4 fragment fragmentMain( v2f in [[stage_in]],
                             texture2d< half, access::sample > normalTexture [[texture(1)]],
                             texture2d< half, access::sample > pbrTexture [[texture(2)]],
                             texture2d< half, access::sample > emissiveTexture [[texture(3)]],
-                            texture2d< half, access::sample > occlusionTexture [[texture(4)]]
+                            texture2d< half, access::sample > occlusionTexture [[texture(4)]],
+                            sampler baseColorSampler [[sampler(0)]],
+                            sampler normalSampler [[sampler(1)]],
+                            sampler pbrSampler [[sampler(2)]],
+                            sampler emissiveSampler [[sampler(3)]],
+                            sampler occlusionSampler [[sampler(4)]]
 ) {
     float roughness = material.roughnessFactor;
     float metallic = material.metallicFactor;
     half3 baseColor = half3(material.baseColor.rgb);
     half alpha = material.baseColor.a;
 
-    constexpr sampler s( address::repeat, filter::linear );
-    half3 emissive = emissiveTexture.sample( s, in.uv ).rgb;
-    half ao = occlusionTexture.sample( s, in.uv ).r;
-    baseColor *= baseColorTexture.sample( s, in.uv ).rgb;
-    alpha *= baseColorTexture.sample( s, in.uv ).a;
-    float3 N = float3(normalTexture.sample( s, in.uv ).rgb);
-    roughness *= pbrTexture.sample( s, in.uv ).g;
-    metallic *= pbrTexture.sample( s, in.uv ).b;
-    N = normalize(float3x3(in.tangentW, in.bitangentW, in.normalW) * (2.0 * N - 1.0));
+    // glTF samplers, bound per texture (see samplers.hpp)
+    half3 emissive = material.emissiveTexture >= 0 ? emissiveTexture.sample( emissiveSampler, getUv(material, 3, in.uv) ).rgb : half3(0.0);
+    if (material.baseColorTexture >= 0) {
+        half4 color = baseColorTexture.sample( baseColorSampler, getUv(material, 0, in.uv) );
+        baseColor *= color.rgb;
+        alpha *= color.a;
+    }
+    half4 pbr = material.metallicRoughnessTexture >= 0 ? pbrTexture.sample( pbrSampler, getUv(material, 2, in.uv) ) : half4(1.0);
+    roughness *= pbr.g;
+    metallic *= pbr.b;
+    // occlusion packed into the red channel of the metallicRoughness texture (ORM) comes with the same fetch
+    half ao = half(1.0);
+    if (material.occlusionTexture >= 0) {
+        ao = material.occlusionTexture == material.metallicRoughnessTexture ? pbr.r : occlusionTexture.sample( occlusionSampler, getUv(material, 4, in.uv) ).r;
+    }
     roughness = fmax(roughness, 0.01);
-    if (isnan(length(in.tangentW))) {
-        N = normalize((uniforms.normal * float4(in.normal, 0.0)).xyz);
-    } else {
-        N = normalize((uniforms.model * float4(in.normal, 0.0)).xyz);
+    // tangents are generated at load time for every normal mapped primitive
+    float3 N = normalize(in.normalW);
+    if (material.normalTexture >= 0) {
+        // z is rebuilt from xy, BC5 normal maps only store two channels
+        float2 xy = 2.0 * float2(normalTexture.sample( normalSampler, getUv(material, 1, in.uv) ).rg) - 1.0;
+        float3 n = float3(xy, sqrt(saturate(1.0 - dot(xy, xy))));
+        N = normalize(float3x3(normalize(in.tangentW), normalize(in.bitangentW), N) * n);
     }
 
     half3 lightColor = half3(1.0);
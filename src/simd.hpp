@@ -0,0 +1,92 @@
+#include <cmath>
+#include <cstdint>
+
+#if defined(__ARM_NEON)
+#include <arm_neon.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+// Minimal 4-wide float helpers over NEON / SSE2 with a scalar fallback.
+#if defined(__ARM_NEON)
+typedef float32x4_t float4;
+
+inline float4 load4(const float *p) { return vld1q_f32(p); }
+inline void store4(float *p, float4 v) { vst1q_f32(p, v); }
+inline float4 splat4(float v) { return vdupq_n_f32(v); }
+inline float4 add4(float4 a, float4 b) { return vaddq_f32(a, b); }
+inline float4 sub4(float4 a, float4 b) { return vsubq_f32(a, b); }
+inline float4 mul4(float4 a, float4 b) { return vmulq_f32(a, b); }
+inline float4 div4(float4 a, float4 b) { return vdivq_f32(a, b); }
+inline float4 min4(float4 a, float4 b) { return vminq_f32(a, b); }
+inline float4 max4(float4 a, float4 b) { return vmaxq_f32(a, b); }
+inline float4 sqrt4(float4 a) { return vsqrtq_f32(a); }
+inline float4 abs4(float4 a) { return vabsq_f32(a); }
+// a with its sign flipped where b is negative
+inline float4 xorsign4(float4 a, float4 b) {
+    uint32x4_t sign = vandq_u32(vreinterpretq_u32_f32(b), vdupq_n_u32(0x80000000));
+    return vreinterpretq_f32_u32(veorq_u32(vreinterpretq_u32_f32(a), sign));
+}
+inline void truncate4(int32_t *p, float4 v) { vst1q_s32(p, vcvtq_s32_f32(v)); }
+// bit i is set when lane i of a >= b
+inline int gemask4(float4 a, float4 b) {
+    uint32x4_t m = vshrq_n_u32(vcgeq_f32(a, b), 31);
+    static const int32_t shifts[4] = {0, 1, 2, 3};
+    return vaddvq_u32(vshlq_u32(m, vld1q_s32(shifts)));
+}
+#elif defined(__SSE2__)
+typedef __m128 float4;
+
+inline float4 load4(const float *p) { return _mm_loadu_ps(p); }
+inline void store4(float *p, float4 v) { _mm_storeu_ps(p, v); }
+inline float4 splat4(float v) { return _mm_set1_ps(v); }
+inline float4 add4(float4 a, float4 b) { return _mm_add_ps(a, b); }
+inline float4 sub4(float4 a, float4 b) { return _mm_sub_ps(a, b); }
+inline float4 mul4(float4 a, float4 b) { return _mm_mul_ps(a, b); }
+inline float4 div4(float4 a, float4 b) { return _mm_div_ps(a, b); }
+inline float4 min4(float4 a, float4 b) { return _mm_min_ps(a, b); }
+inline float4 max4(float4 a, float4 b) { return _mm_max_ps(a, b); }
+inline float4 sqrt4(float4 a) { return _mm_sqrt_ps(a); }
+inline float4 abs4(float4 a) { return _mm_andnot_ps(_mm_set1_ps(-0.0f), a); }
+inline float4 xorsign4(float4 a, float4 b) { return _mm_xor_ps(a, _mm_and_ps(b, _mm_set1_ps(-0.0f))); }
+inline void truncate4(int32_t *p, float4 v) { _mm_storeu_si128((__m128i *)p, _mm_cvttps_epi32(v)); }
+inline int gemask4(float4 a, float4 b) { return _mm_movemask_ps(_mm_cmpge_ps(a, b)); }
+#else
+struct float4 {
+    float v[4];
+};
+
+inline float4 load4(const float *p) { return float4{{p[0], p[1], p[2], p[3]}}; }
+inline void store4(float *p, float4 a) {
+    for (int i = 0; i < 4; i++) p[i] = a.v[i];
+}
+inline float4 splat4(float v) { return float4{{v, v, v, v}}; }
+#define SIMD_SCALAR_OP(name, expr)                 \
+    inline float4 name(float4 a, float4 b) {       \
+        float4 r;                                  \
+        for (int i = 0; i < 4; i++) r.v[i] = expr; \
+        return r;                                  \
+    }
+SIMD_SCALAR_OP(add4, a.v[i] + b.v[i])
+SIMD_SCALAR_OP(sub4, a.v[i] - b.v[i])
+SIMD_SCALAR_OP(mul4, a.v[i] * b.v[i])
+SIMD_SCALAR_OP(div4, a.v[i] / b.v[i])
+SIMD_SCALAR_OP(min4, fminf(a.v[i], b.v[i]))
+SIMD_SCALAR_OP(max4, fmaxf(a.v[i], b.v[i]))
+#undef SIMD_SCALAR_OP
+inline float4 sqrt4(float4 a) { return float4{{sqrtf(a.v[0]), sqrtf(a.v[1]), sqrtf(a.v[2]), sqrtf(a.v[3])}}; }
+inline float4 abs4(float4 a) { return float4{{fabsf(a.v[0]), fabsf(a.v[1]), fabsf(a.v[2]), fabsf(a.v[3])}}; }
+inline float4 xorsign4(float4 a, float4 b) {
+    float4 r;
+    for (int i = 0; i < 4; i++) r.v[i] = std::signbit(b.v[i]) ? -a.v[i] : a.v[i];
+    return r;
+}
+inline void truncate4(int32_t *p, float4 a) {
+    for (int i = 0; i < 4; i++) p[i] = (int32_t)a.v[i];
+}
+inline int gemask4(float4 a, float4 b) {
+    int m = 0;
+    for (int i = 0; i < 4; i++) m |= (a.v[i] >= b.v[i]) << i;
+    return m;
+}
+#endif
@@ -0,0 +1,343 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <future>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <unordered_map>
+#include <vector>
+
+// Symmetric 4x4 plane quadric: a00 a01 a02 a03 a11 a12 a13 a22 a23 a33.
+struct Quadric {
+    double a[10] = {0, 0, 0, 0, 0, 0, 0, 0, 0, 0};
+
+    void add(const Quadric &q) {
+        for (int i = 0; i < 10; i++) {
+            a[i] += q.a[i];
+        }
+    }
+
+    double error(const float *p) const {
+        double x = p[0], y = p[1], z = p[2];
+        double r = a[0] * x * x + a[4] * y * y + a[7] * z * z + a[9];
+        r += 2.0 * (a[1] * x * y + a[2] * x * z + a[5] * y * z + a[3] * x + a[6] * y + a[8] * z);
+        return r > 0.0 ? r : 0.0;
+    }
+};
+
+Quadric getPlaneQuadric(double nx, double ny, double nz, double d) {
+    Quadric q;
+    q.a[0] = nx * nx, q.a[1] = nx * ny, q.a[2] = nx * nz, q.a[3] = nx * d;
+    q.a[4] = ny * ny, q.a[5] = ny * nz, q.a[6] = ny * d;
+    q.a[7] = nz * nz, q.a[8] = nz * d;
+    q.a[9] = d * d;
+    return q;
+}
+
+// Quadric error edge collapse onto existing vertices. Border and non-manifold vertices are locked, which also keeps
+// uv / normal seams (split vertices look like borders in index space) and open edges in place. Every call continues
+// from the previous result, so a LOD chain is built by asking for fewer and fewer triangles.
+class Simplifier {
+public:
+    Simplifier(const std::vector<uint32_t> &indices, const std::vector<float> &positions)
+        : indices(indices), positions(positions), quadrics(positions.size() / 3), remap(positions.size() / 3) {
+        size_t count = positions.size() / 3;
+        locked.assign(count, false);
+        for (size_t i = 0; i < count; i++) {
+            remap[i] = i;
+        }
+        std::unordered_map<uint64_t, int> edges;
+        for (size_t i = 0; i + 2 < indices.size(); i += 3) {
+            for (int k = 0; k < 3; k++) {
+                uint32_t a = indices[i + k], b = indices[i + (k + 1) % 3];
+                edges[((uint64_t)std::min(a, b) << 32) | std::max(a, b)]++;
+            }
+            const float *p0 = &positions[indices[i] * 3];
+            const float *p1 = &positions[indices[i + 1] * 3];
+            const float *p2 = &positions[indices[i + 2] * 3];
+            double e1[3] = {p1[0] - p0[0], p1[1] - p0[1], p1[2] - p0[2]};
+            double e2[3] = {p2[0] - p0[0], p2[1] - p0[1], p2[2] - p0[2]};
+            double n[3] = {e1[1] * e2[2] - e1[2] * e2[1], e1[2] * e2[0] - e1[0] * e2[2], e1[0] * e2[1] - e1[1] * e2[0]};
+            double l = sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+            if (l == 0.0) {
+                continue;
+            }
+            Quadric q = getPlaneQuadric(n[0] / l, n[1] / l, n[2] / l, -(n[0] * p0[0] + n[1] * p0[1] + n[2] * p0[2]) / l);
+            for (int k = 0; k < 3; k++) {
+                quadrics[indices[i + k]].add(q);
+            }
+        }
+        for (auto &[key, uses] : edges) {
+            if (uses != 2) {
+                locked[key >> 32] = true;
+                locked[key & 0xFFFFFFFF] = true;
+            }
+        }
+    }
+
+    // Collapses edges, cheapest first, until at most target indices are left or nothing can be collapsed.
+    const std::vector<uint32_t> &simplify(size_t target) {
+        while (indices.size() > target) {
+            if (collapse(target) == 0) {
+                break;
+            }
+        }
+        return indices;
+    }
+
+    float getError() const { return sqrt(error); }
+
+private:
+    struct Collapse {
+        uint32_t from;
+        uint32_t to;
+        double cost;
+    };
+
+    bool flips(uint32_t from, uint32_t to, const std::vector<uint32_t> &triangles, size_t first, size_t last) {
+        const float *target = &positions[to * 3];
+        for (size_t t = first; t < last; t++) {
+            const uint32_t *tri = &indices[triangles[t] * 3];
+            if (tri[0] == to || tri[1] == to || tri[2] == to) {
+                continue;
+            }
+            const float *p[3];
+            const float *q[3];
+            for (int k = 0; k < 3; k++) {
+                p[k] = &positions[tri[k] * 3];
+                q[k] = tri[k] == from ? target : p[k];
+            }
+            float before[3], after[3];
+            getNormal(p, before);
+            getNormal(q, after);
+            if (before[0] * after[0] + before[1] * after[1] + before[2] * after[2] <= 0.0f) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    static void getNormal(const float *p[3], float *n) {
+        float e1[3] = {p[1][0] - p[0][0], p[1][1] - p[0][1], p[1][2] - p[0][2]};
+        float e2[3] = {p[2][0] - p[0][0], p[2][1] - p[0][1], p[2][2] - p[0][2]};
+        n[0] = e1[1] * e2[2] - e1[2] * e2[1];
+        n[1] = e1[2] * e2[0] - e1[0] * e2[2];
+        n[2] = e1[0] * e2[1] - e1[1] * e2[0];
+    }
+
+    // One pass over the current edges; a collapse locks the one-ring of its source vertex for the rest of the pass,
+    // so every flip test below sees up to date positions.
+    size_t collapse(size_t target) {
+        size_t count = positions.size() / 3;
+        std::vector<Collapse> candidates;
+        candidates.reserve(indices.size() * 2);
+        for (size_t i = 0; i < indices.size(); i += 3) {
+            for (int k = 0; k < 3; k++) {
+                uint32_t a = indices[i + k], b = indices[i + (k + 1) % 3];
+                for (auto [from, to] : {std::make_pair(a, b), std::make_pair(b, a)}) {
+                    if (!locked[from]) {
+                        Quadric q = quadrics[from];
+                        q.add(quadrics[to]);
+                        candidates.push_back(Collapse{from, to, q.error(&positions[to * 3])});
+                    }
+                }
+            }
+        }
+        std::sort(candidates.begin(), candidates.end(), [](const Collapse &a, const Collapse &b) {
+            return a.cost < b.cost;
+        });
+
+        // vertex to triangle adjacency
+        std::vector<uint32_t> offsets(count + 1, 0);
+        for (uint32_t v : indices) {
+            offsets[v + 1]++;
+        }
+        for (size_t i = 0; i < count; i++) {
+            offsets[i + 1] += offsets[i];
+        }
+        std::vector<uint32_t> triangles(indices.size());
+        std::vector<uint32_t> fill(offsets.begin(), offsets.end() - 1);
+        for (size_t i = 0; i < indices.size(); i++) {
+            triangles[fill[indices[i]]++] = i / 3;
+        }
+
+        std::vector<bool> touched(count, false);
+        size_t collapsed = 0;
+        size_t left = indices.size();
+        for (const Collapse &c : candidates) {
+            if (left <= target) {
+                break;
+            }
+            if (touched[c.from] || touched[c.to] || flips(c.from, c.to, triangles, offsets[c.from], offsets[c.from + 1])) {
+                continue;
+            }
+            for (size_t t = offsets[c.from]; t < offsets[c.from + 1]; t++) {
+                for (int k = 0; k < 3; k++) {
+                    touched[indices[triangles[t] * 3 + k]] = true;
+                }
+            }
+            remap[c.from] = c.to;
+            quadrics[c.to].add(quadrics[c.from]);
+            error = std::max(error, c.cost);
+            collapsed++;
+            // an interior edge collapse removes two triangles
+            left -= std::min<size_t>(left, 6);
+        }
+
+        size_t write = 0;
+        for (size_t i = 0; i < indices.size(); i += 3) {
+            uint32_t a = remap[indices[i]], b = remap[indices[i + 1]], c = remap[indices[i + 2]];
+            if (a != b && b != c && a != c) {
+                indices[write++] = a;
+                indices[write++] = b;
+                indices[write++] = c;
+            }
+        }
+        indices.resize(write);
+        return collapsed;
+    }
+
+    std::vector<uint32_t> indices;
+    const std::vector<float> &positions;
+    std::vector<Quadric> quadrics;
+    std::vector<uint32_t> remap;
+    std::vector<bool> locked;
+    double error = 0.0;
+};
+
+const size_t kLodMinTriangles = 1024;
+const int kLodMaxLevels = 4;
+
+// Index-only LOD chain, every level asks for half the triangles of the previous one; stops when a level no longer
+// gets meaningfully smaller. The report line is printed by the caller so the output stays in order.
+std::vector<std::pair<std::vector<uint32_t>, float>> buildLodChain(const std::vector<uint32_t> &indices,
+                                                                   const std::vector<float> &positions,
+                                                                   std::string &report) {
+    std::vector<std::pair<std::vector<uint32_t>, float>> r;
+    std::ostringstream s;
+    s << indices.size() / 3 << " tris";
+    Simplifier simplifier(indices, positions);
+    size_t previous = indices.size();
+    for (int level = 0; level < kLodMaxLevels && previous / 3 >= kLodMinTriangles / 2; level++) {
+        const std::vector<uint32_t> &lod = simplifier.simplify(previous / 6 * 3);
+        if (lod.size() > previous * 9 / 10) {
+            break;
+        }
+        r.emplace_back(lod, simplifier.getError());
+        s << " -> " << lod.size() / 3 << " (error " << simplifier.getError() << ")";
+        previous = lod.size();
+    }
+    report = s.str();
+    return r;
+}
+
+void buildLods(ThreadPool &pool,
+               std::vector<Mesh> &meshes,
+               std::vector<Buffer> &geometries,
+               const std::vector<unsigned char> &buffer) {
+    auto start = std::chrono::steady_clock::now();
+    std::map<std::pair<int, int>, std::vector<Geometry *>> jobs;
+    for (auto &mesh : meshes) {
+        Geometry *g = mesh.geometry;
+        if (geometries[g->index].count / 3 >= (int)kLodMinTriangles) {
+            jobs[{g->index, g->position}].push_back(g);
+        }
+    }
+    for (auto &[key, g] : jobs) {
+        getData(geometries[key.first], buffer);
+        getData(geometries[key.second], buffer);
+    }
+
+    typedef std::vector<std::pair<std::vector<uint32_t>, float>> Chain;
+    std::vector<std::string> reports(jobs.size());
+    std::vector<std::future<Chain>> futures;
+    for (auto &[key, g] : jobs) {
+        std::pair<int, int> k = key;
+        std::string *report = &reports[futures.size()];
+        futures.push_back(pool.submit([k, report, &geometries, &buffer] {
+            std::vector<float> positions = readFloats(geometries[k.second], buffer);
+            return buildLodChain(readIndices(geometries[k.first], buffer), positions, *report);
+        }));
+    }
+    std::vector<Chain> chains;
+    for (auto &f : futures) {
+        chains.push_back(f.get());
+    }
+
+    size_t i = 0;
+    for (auto &[key, g] : jobs) {
+        std::vector<Lod> lods;
+        for (auto &[indices, error] : chains[i]) {
+            Buffer b{0, (int)(indices.size() * 4), (int)indices.size(), 4, 0};
+            b.componentType = 5125;
+            b.data.resize(b.length);
+            memcpy(b.data.data(), indices.data(), b.length);
+            geometries.push_back(std::move(b));
+            lods.push_back(Lod{(int)geometries.size() - 1, error});
+        }
+        for (Geometry *geometry : g) {
+            geometry->lods = lods;
+        }
+        std::cout << "lod: " << reports[i] << std::endl;
+        i++;
+    }
+    if (!jobs.empty()) {
+        auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start);
+        std::cout << "lod: " << jobs.size() << " chains in " << ms.count() << " ms" << std::endl;
+    }
+}
+
+// Bounding sphere of every drawn geometry, in object space, for LOD selection and texture streaming.
+void buildBoundingSpheres(std::vector<Mesh> &meshes,
+                          std::vector<Buffer> &geometries,
+                          std::vector<unsigned char> &buffer) {
+    for (auto &mesh : meshes) {
+        Buffer &p = geometries[mesh.geometry->position];
+        std::vector<float> positions = readFloats(p, buffer);
+        float min[3] = {INFINITY, INFINITY, INFINITY};
+        float max[3] = {-INFINITY, -INFINITY, -INFINITY};
+        for (size_t v = 0; v < positions.size(); v += 3) {
+            for (int c = 0; c < 3; c++) {
+                min[c] = fminf(min[c], positions[v + c]);
+                max[c] = fmaxf(max[c], positions[v + c]);
+            }
+        }
+        float radius = 0.0f;
+        for (int c = 0; c < 3; c++) {
+            mesh.geometry->center[c] = (min[c] + max[c]) * 0.5f;
+            radius += (max[c] - min[c]) * (max[c] - min[c]) * 0.25f;
+        }
+        mesh.geometry->radius = sqrtf(radius);
+    }
+}
+
+// How many pixels one object space unit at the near side of g's bounding sphere covers, scale is the largest axis
+// scale of model.
+float getPixelsPerUnit(const Geometry &g, const glm::mat4 &model, const glm::vec3 &eye, float viewportHeight,
+                       float &scale) {
+    glm::vec4 center = model * glm::vec4(g.center[0], g.center[1], g.center[2], 1.0f);
+    scale = std::max({glm::length(glm::vec3(model[0])), glm::length(glm::vec3(model[1])),
+                      glm::length(glm::vec3(model[2]))});
+    float distance = std::max(glm::length(glm::vec3(center) - eye) - g.radius * scale, 1e-4f);
+    // camera() uses a 0.78 rad vertical field of view
+    return viewportHeight / (2.0f * distance * tanf(0.78f * 0.5f));
+}
+
+// Coarsest level whose simplification error, projected at the bounding sphere distance, stays under maxPixels.
+int selectLod(const Geometry &g, const glm::mat4 &model, const glm::vec3 &eye, float viewportHeight, float maxPixels) {
+    if (g.lods.empty()) {
+        return g.index;
+    }
+    float scale;
+    float pixelsPerUnit = getPixelsPerUnit(g, model, eye, viewportHeight, scale);
+    int r = g.index;
+    for (const Lod &lod : g.lods) {
+        if (lod.error * scale * pixelsPerUnit > maxPixels) {
+            break;
+        }
+        r = lod.index;
+    }
+    return r;
+}
@@ -0,0 +1,672 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <future>
+#include <iostream>
+#include <map>
+#include <vector>
+
+// levels up to this size are uploaded as soon as an image arrives, ignoring the budget
+const int kStreamTailSize = 64;
+
+MTL::PixelFormat getPixelFormat(const Image &image, TextureRole role) {
+    bool srgb = role == TextureColor;
+    switch (image.format) {
+        case BlockBC4:
+            return MTL::PixelFormatBC4_RUnorm;
+        case BlockBC5:
+            return MTL::PixelFormatBC5_RGUnorm;
+        case BlockBC7:
+            return srgb ? MTL::PixelFormatBC7_RGBAUnorm_sRGB : MTL::PixelFormatBC7_RGBAUnorm;
+        default:
+            break;
+    }
+    switch (image.channels) {
+        case 1:
+            return MTL::PixelFormatR8Unorm;
+        case 2:
+            return MTL::PixelFormatRG8Unorm;
+        default:
+            return srgb ? MTL::PixelFormatRGBA8Unorm_sRGB : MTL::PixelFormatRGBA8Unorm;
+    }
+}
+
+const unsigned char *getLevelData(const Image &image, int level) {
+    if (image.format != BlockNone) {
+        return image.compressed[level].data();
+    }
+    return level == 0 ? image.buffer : image.mips[level - 1].data();
+}
+
+size_t getLevelBytes(const Image &image, int level) {
+    int width = std::max(image.width >> level, 1);
+    int height = std::max(image.height >> level, 1);
+    return image.format != BlockNone ? getCompressedSize(width, height, image.format)
+                                     : (size_t)width * height * image.channels;
+}
+
+int getRowBytes(const Image &image, int level) {
+    int width = std::max(image.width >> level, 1);
+    return image.format != BlockNone ? (width + 3) / 4 * getBlockBytes(image.format) : width * image.channels;
+}
+
+// every level back to back, the layout of the "texture" cache entries
+std::vector<unsigned char> packLevels(const Image &image, int levels) {
+    std::vector<unsigned char> r;
+    for (int level = 0; level < levels; level++) {
+        const unsigned char *p = getLevelData(image, level);
+        r.insert(r.end(), p, p + getLevelBytes(image, level));
+    }
+    return r;
+}
+
+void unpackLevels(Image &image, int levels, const std::vector<unsigned char> &data) {
+    const unsigned char *p = data.data();
+    for (int level = 0; level < levels; level++) {
+        size_t size = getLevelBytes(image, level);
+        if (image.format != BlockNone) {
+            image.compressed.emplace_back(p, p + size);
+        } else if (level == 0) {
+            image.buffer = (unsigned char *)malloc(size);
+            memcpy(image.buffer, p, size);
+        } else {
+            image.mips.emplace_back(p, p + size);
+        }
+        p += size;
+    }
+}
+
+void freeLevels(Image &image) {
+    free(image.buffer);
+    image.buffer = nullptr;
+    image.mips = {};
+    image.compressed = {};
+}
+
+Hash128 getHash(const Image &image) {
+    return Hash128{image.hash[0], image.hash[1]};
+}
+
+// Textures shared by the renderers of the session, keyed by device and image hash (see dedupImages). The map holds no
+// reference of its own: an entry lives while streamer entries draw with its texture, so once the last of them evicts
+// or drops it the memory goes with their retired copy.
+struct SharedTexture {
+    MTL::Texture *texture;
+    int top;
+    int users = 0; // streamer entries whose texture this is
+};
+std::map<std::pair<MTL::Device *, Hash128>, SharedTexture> sharedTextures;
+
+struct ResidencyStats {
+    size_t gpuBytes = 0;
+    size_t cpuBytes = 0;
+    int evicted = 0;  // levels dropped from the GPU
+    int spilled = 0;  // images whose texels were dropped from memory
+    int reloaded = 0; // images read back from the cache
+    int shared = 0;   // textures taken from another renderer
+};
+
+// Progressive texture upload and residency. Until an image is resident its texture is nullptr and draws bind a per slot placeholder
+// that samples like a missing texture, or its preview once one arrived from the decode jobs. Once the image pipeline finishes, every image gets its small levels at once;
+// then, each frame, the most undersampled textures grow one or more levels towards the size they cover on screen,
+// within a byte budget. Growing reallocates the texture with the new top level and copies the resident levels over
+// on the GPU; the old texture is released once no frame in flight can sample it.
+// Past gpuBudget, the least recently drawn textures shrink back by their top levels (never below the small levels).
+// Past cpuBudget, the texels of the least recently drawn images are written to the cache and freed, and read back on
+// the pool when the texture has to grow again.
+class TextureStreamer {
+public:
+    TextureStreamer(MTL::Device *pDevice,
+                    ThreadPool &pool,
+                    const std::vector<int> &sources,
+                    const std::vector<TextureRole> &roles,
+                    std::future<std::vector<Image>> images,
+                    PreviewQueue *previews,
+                    int framesInFlight);
+    ~TextureStreamer();
+    // screen size in pixels of a draw using the glTF texture, gathered for the next update()
+    void request(int texture, float pixels);
+    // uploads up to budget bytes and keeps the resident bytes within gpuBudget and cpuBudget, the copies are encoded
+    // into pCmd ahead of the frame's render pass
+    void update(MTL::CommandBuffer *pCmd, size_t budget, size_t gpuBudget, size_t cpuBudget);
+    // blocks until the images are decoded and uploads them in full
+    void finish();
+    MTL::Texture *getTexture(int texture, int slot);
+    ResidencyStats getStats() const;
+
+private:
+    struct Entry {
+        Image image{0, 0, 0, nullptr};
+        TextureRole role;
+        MTL::Texture *texture = nullptr;
+        MTL::Texture *preview = nullptr; // until the pipeline delivers the image
+        int top = 0; // first resident level
+        float pixels = 0.0f;
+        std::vector<int> users; // glTF textures sampling this image
+        int levels = 0;
+        int tail = 0; // top of the small levels that stay resident
+        size_t bytes = 0; // all levels
+        int lastUsed = 0;
+        bool spilled = false; // texels only in the cache
+        bool lost = false;    // the cache entry could not be read back
+        bool shared = false;  // counted in the users of its sharedTextures entry
+        uint64_t key = 0;
+        std::future<bool> spilling;
+        std::future<std::vector<unsigned char>> reloading;
+    };
+    struct Retired {
+        int frame;
+        MTL::Texture *texture;
+    };
+
+    void showPreviews();
+    void dropPreviews();
+    bool receive();
+    bool adopt(Entry &e);
+    void publish(Entry &e);
+    void unshare(Entry &e);
+    void poll();
+    void evict(size_t gpuBudget, MTL::CommandBuffer *pCmd, MTL::BlitCommandEncoder *&pBlit);
+    void spill(size_t cpuBudget);
+    size_t getGpuBytes(const Entry &e);
+    int getTargetLevel(const Entry &e, bool full);
+    void upload(Entry &e, int top, MTL::CommandBuffer *pCmd, MTL::BlitCommandEncoder *&pBlit);
+
+    MTL::Device *_pDevice;
+    ThreadPool &pool;
+    std::vector<int> sources;
+    std::vector<Entry> entries;
+    std::vector<MTL::Texture *> textures;
+    MTL::Texture *placeholders[5];
+    std::future<std::vector<Image>> pending;
+    PreviewQueue *previews;
+    std::chrono::steady_clock::time_point start;
+    std::vector<Retired> retired;
+    ResidencyStats stats;
+    int frame = 0;
+    int framesInFlight;
+};
+
+TextureStreamer::TextureStreamer(MTL::Device *pDevice,
+                                 ThreadPool &pool,
+                                 const std::vector<int> &sources,
+                                 const std::vector<TextureRole> &roles,
+                                 std::future<std::vector<Image>> images,
+                                 PreviewQueue *previews,
+                                 int framesInFlight)
+    : _pDevice(pDevice),
+      pool(pool),
+      sources(sources),
+      entries(roles.size()),
+      textures(sources.size(), nullptr),
+      pending(std::move(images)),
+      previews(previews),
+      start(std::chrono::steady_clock::now()),
+      framesInFlight(framesInFlight) {
+    for (size_t i = 0; i < entries.size(); i++) {
+        entries[i].role = roles[i];
+    }
+    for (size_t t = 0; t < sources.size(); t++) {
+        if (sources[t] >= 0 && sources[t] < (int)entries.size()) {
+            entries[sources[t]].users.push_back(t);
+        }
+    }
+
+    // baseColor, normal, metallicRoughness, emissive and occlusion, each neutral like an absent texture
+    const uint8_t texels[5][4] = {
+        {255, 255, 255, 255}, {128, 128, 255, 255}, {255, 255, 255, 255}, {0, 0, 0, 255}, {255, 255, 255, 255}};
+    MTL::TextureDescriptor *pTextureDesc = MTL::TextureDescriptor::texture2DDescriptor(
+        MTL::PixelFormatRGBA8Unorm, 1, 1, false);
+    pTextureDesc->setStorageMode(MTL::StorageModeManaged);
+    for (int slot = 0; slot < 5; slot++) {
+        placeholders[slot] = _pDevice->newTexture(pTextureDesc);
+        placeholders[slot]->replaceRegion(MTL::Region(0, 0, 0, 1, 1, 1), 0, texels[slot], 4);
+    }
+}
+
+TextureStreamer::~TextureStreamer() {
+    for (auto &e : entries) {
+        unshare(e);
+        if (e.spilling.valid()) {
+            e.spilling.wait();
+        }
+        if (e.reloading.valid()) {
+            e.reloading.wait();
+        }
+        if (e.texture) {
+            e.texture->release();
+        }
+        if (e.preview) {
+            e.preview->release();
+        }
+        freeLevels(e.image);
+    }
+    // the decode jobs are done once pending is
+    if (pending.valid()) {
+        pending.wait();
+    }
+    dropPreviews();
+    for (auto &r : retired) {
+        r.texture->release();
+    }
+    for (auto *p : placeholders) {
+        p->release();
+    }
+}
+
+void TextureStreamer::request(int texture, float pixels) {
+    if (texture >= 0 && texture < (int)sources.size() && sources[texture] >= 0 &&
+        sources[texture] < (int)entries.size()) {
+        Entry &e = entries[sources[texture]];
+        e.pixels = std::max(e.pixels, pixels);
+        e.lastUsed = frame;
+    }
+}
+
+MTL::Texture *TextureStreamer::getTexture(int texture, int slot) {
+    MTL::Texture *r = texture >= 0 && texture < (int)textures.size() ? textures[texture] : nullptr;
+    return r ? r : placeholders[slot];
+}
+
+// Uploads the previews that arrived since the last frame, with their mip chain, as the textures of their users.
+void TextureStreamer::showPreviews() {
+    std::vector<std::pair<size_t, Image>> arrived;
+    if (previews) {
+        std::lock_guard<std::mutex> lock(previews->mutex);
+        arrived.swap(previews->images);
+    }
+    for (auto &[i, image] : arrived) {
+        if (i < entries.size() && !entries[i].preview && image.buffer) {
+            Entry &e = entries[i];
+            buildMipChain(image, e.role);
+            MTL::TextureDescriptor *pTextureDesc = MTL::TextureDescriptor::alloc()->init();
+            pTextureDesc->setWidth(image.width);
+            pTextureDesc->setHeight(image.height);
+            pTextureDesc->setPixelFormat(getPixelFormat(image, e.role));
+            pTextureDesc->setTextureType(MTL::TextureType2D);
+            pTextureDesc->setMipmapLevelCount(1 + image.mips.size());
+            pTextureDesc->setStorageMode(MTL::StorageModeManaged);
+            pTextureDesc->setUsage(MTL::ResourceUsageSample | MTL::ResourceUsageRead);
+            e.preview = _pDevice->newTexture(pTextureDesc);
+            pTextureDesc->release();
+            for (int level = 0; level <= (int)image.mips.size(); level++) {
+                int width = std::max(image.width >> level, 1);
+                int height = std::max(image.height >> level, 1);
+                e.preview->replaceRegion(MTL::Region(0, 0, 0, width, height, 1),
+                                         level,
+                                         getLevelData(image, level),
+                                         getRowBytes(image, level));
+            }
+            for (int t : e.users) {
+                textures[t] = e.preview;
+            }
+        }
+        freeLevels(image);
+    }
+}
+
+// previews that arrived too late to be shown
+void TextureStreamer::dropPreviews() {
+    if (!previews) {
+        return;
+    }
+    std::lock_guard<std::mutex> lock(previews->mutex);
+    for (auto &[i, image] : previews->images) {
+        freeLevels(image);
+    }
+    previews->images.clear();
+}
+
+// takes over the decoded images once the pipeline is done, false while it is still running
+bool TextureStreamer::receive() {
+    if (!pending.valid()) {
+        return true;
+    }
+    if (pending.wait_for(std::chrono::seconds(0)) != std::future_status::ready) {
+        showPreviews();
+        return false;
+    }
+    std::vector<Image> images = pending.get();
+    // the real levels are uploaded this frame, previews retire like a replaced texture
+    dropPreviews();
+    for (auto &e : entries) {
+        if (e.preview) {
+            retired.push_back(Retired{frame + framesInFlight, e.preview});
+            e.preview = nullptr;
+            for (int t : e.users) {
+                textures[t] = nullptr;
+            }
+        }
+    }
+    for (size_t i = 0; i < images.size() && i < entries.size(); i++) {
+        Entry &e = entries[i];
+        e.image = std::move(images[i]);
+        e.levels = hasPixels(e.image) ? getMipCount(e.image) : 0;
+        while (e.tail < e.levels - 1 &&
+               std::max(e.image.width >> e.tail, e.image.height >> e.tail) > kStreamTailSize) {
+            e.tail++;
+        }
+        for (int level = 0; level < e.levels; level++) {
+            e.bytes += getLevelBytes(e.image, level);
+        }
+    }
+    // duplicates hand their textures over to the first copy
+    for (auto &e : entries) {
+        if (e.image.duplicate < 0 || e.image.duplicate >= (int)entries.size()) {
+            continue;
+        }
+        for (int t : e.users) {
+            sources[t] = e.image.duplicate;
+            entries[e.image.duplicate].users.push_back(t);
+        }
+        e.users.clear();
+    }
+    auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start);
+    std::cout << "streaming: " << images.size() << " images ready after " << ms.count() << " ms" << std::endl;
+    return true;
+}
+
+// the level whose texels map about one to one onto the screen, assuming the uv range spans the draw
+int TextureStreamer::getTargetLevel(const Entry &e, bool full) {
+    int last = e.levels - 1;
+    if (full) {
+        return 0;
+    }
+    if (e.pixels <= 0.0f) {
+        return e.texture ? e.top : last;
+    }
+    float size = std::max(e.image.width, e.image.height);
+    int level = (int)floorf(log2f(std::max(size / e.pixels, 1.0f)));
+    return std::min(level, last);
+}
+
+// takes the session's texture for e's image when it has more levels than e's own
+bool TextureStreamer::adopt(Entry &e) {
+    auto it = sharedTextures.find({_pDevice, getHash(e.image)});
+    if (getHash(e.image) == Hash128{0, 0} || it == sharedTextures.end() || it->second.texture == e.texture ||
+        (e.texture && it->second.top >= e.top)) {
+        return false;
+    }
+    unshare(e);
+    if (e.texture) {
+        retired.push_back(Retired{frame + framesInFlight, e.texture});
+    }
+    e.texture = it->second.texture->retain();
+    e.top = it->second.top;
+    e.shared = true;
+    it->second.users++;
+    for (int t : e.users) {
+        textures[t] = e.texture;
+    }
+    stats.shared++;
+    return true;
+}
+
+// offers e's new texture to the other renderers, it replaces the shared one only with more levels; the users of the
+// replaced one keep it until they adopt this one
+void TextureStreamer::publish(Entry &e) {
+    Hash128 hash = getHash(e.image);
+    if (hash == Hash128{0, 0}) {
+        return;
+    }
+    auto it = sharedTextures.find({_pDevice, hash});
+    if (it == sharedTextures.end()) {
+        sharedTextures.emplace(std::make_pair(_pDevice, hash), SharedTexture{e.texture, e.top, 1});
+        e.shared = true;
+    } else if (e.top < it->second.top) {
+        it->second = SharedTexture{e.texture, e.top, 1};
+        e.shared = true;
+    }
+}
+
+// before e's texture is replaced or released: the entry goes with its last user
+void TextureStreamer::unshare(Entry &e) {
+    if (!e.shared) {
+        return;
+    }
+    e.shared = false;
+    auto it = sharedTextures.find({_pDevice, getHash(e.image)});
+    if (it != sharedTextures.end() && it->second.texture == e.texture && --it->second.users == 0) {
+        sharedTextures.erase(it);
+    }
+}
+
+// Reallocates e's texture starting at level top. Levels the old texture has are copied on the GPU, the others come
+// from memory.
+void TextureStreamer::upload(Entry &e, int top, MTL::CommandBuffer *pCmd, MTL::BlitCommandEncoder *&pBlit) {
+    MTL::TextureDescriptor *pTextureDesc = MTL::TextureDescriptor::alloc()->init();
+    pTextureDesc->setWidth(std::max(e.image.width >> top, 1));
+    pTextureDesc->setHeight(std::max(e.image.height >> top, 1));
+    pTextureDesc->setPixelFormat(getPixelFormat(e.image, e.role));
+    pTextureDesc->setTextureType(MTL::TextureType2D);
+    pTextureDesc->setMipmapLevelCount(e.levels - top);
+    pTextureDesc->setStorageMode(MTL::StorageModeManaged);
+    pTextureDesc->setUsage(MTL::ResourceUsageSample | MTL::ResourceUsageRead);
+    MTL::Texture *pTexture = _pDevice->newTexture(pTextureDesc);
+    pTextureDesc->release();
+
+    // without a command buffer to copy with, the whole chain comes from memory
+    int copied = e.texture && pCmd ? std::max(top, e.top) : e.levels;
+    for (int level = top; level < copied; level++) {
+        int width = std::max(e.image.width >> level, 1);
+        int height = std::max(e.image.height >> level, 1);
+        pTexture->replaceRegion(MTL::Region(0, 0, 0, width, height, 1),
+                                level - top,
+                                getLevelData(e.image, level),
+                                getRowBytes(e.image, level));
+    }
+    if (copied < e.levels) {
+        if (!pBlit) {
+            pBlit = pCmd->blitCommandEncoder();
+        }
+        pBlit->copyFromTexture(e.texture, 0, copied - e.top, pTexture, 0, copied - top, 1, e.levels - copied);
+    }
+    unshare(e);
+    MTL::Texture *old = e.texture;
+    if (old) {
+        retired.push_back(Retired{frame + framesInFlight, old});
+    }
+    e.texture = pTexture;
+    e.top = top;
+    for (int t : e.users) {
+        textures[t] = pTexture;
+    }
+    publish(e);
+}
+
+size_t TextureStreamer::getGpuBytes(const Entry &e) {
+    size_t r = 0;
+    for (int level = e.texture ? e.top : e.levels; level < e.levels; level++) {
+        r += getLevelBytes(e.image, level);
+    }
+    return r;
+}
+
+ResidencyStats TextureStreamer::getStats() const {
+    return stats;
+}
+
+// finishes the cache writes started by spill() and the reads started by update()
+void TextureStreamer::poll() {
+    for (auto &e : entries) {
+        if (e.spilling.valid() && e.spilling.wait_for(std::chrono::seconds(0)) == std::future_status::ready) {
+            if (e.spilling.get()) {
+                freeLevels(e.image);
+                e.spilled = true;
+                stats.spilled++;
+            }
+        }
+        if (e.reloading.valid() && e.reloading.wait_for(std::chrono::seconds(0)) == std::future_status::ready) {
+            std::vector<unsigned char> data = e.reloading.get();
+            if (data.size() == e.bytes) {
+                unpackLevels(e.image, e.levels, data);
+                e.spilled = false;
+                stats.reloaded++;
+            } else {
+                std::cout << "unable to reload texture " << getCachePath(e.key, "texture") << std::endl;
+                e.lost = true;
+            }
+        }
+    }
+}
+
+// Shrinks the least recently drawn textures by their top levels until the resident levels, plus the ones the drawn
+// textures still want, fit gpuBudget. What was drawn last frame is kept, it would only stream back in.
+void TextureStreamer::evict(size_t gpuBudget, MTL::CommandBuffer *pCmd, MTL::BlitCommandEncoder *&pBlit) {
+    size_t total = 0;
+    std::vector<std::pair<int, size_t>> lru;
+    for (size_t i = 0; i < entries.size(); i++) {
+        Entry &e = entries[i];
+        total += getGpuBytes(e);
+        for (int level = e.texture ? getTargetLevel(e, false) : e.top; level < e.top; level++) {
+            total += getLevelBytes(e.image, level);
+        }
+        if (e.texture && e.top < e.tail && e.lastUsed < frame - 1) {
+            lru.emplace_back(e.lastUsed, i);
+        }
+    }
+    std::sort(lru.begin(), lru.end());
+    for (auto &[lastUsed, i] : lru) {
+        if (total <= gpuBudget) {
+            break;
+        }
+        Entry &e = entries[i];
+        int top = e.top;
+        for (; total > gpuBudget && top < e.tail; top++) {
+            total -= getLevelBytes(e.image, top);
+        }
+        stats.evicted += top - e.top;
+        upload(e, top, pCmd, pBlit);
+    }
+}
+
+// Moves the texels of the least recently drawn images to the cache until the ones in memory fit cpuBudget.
+void TextureStreamer::spill(size_t cpuBudget) {
+    size_t total = 0;
+    std::vector<std::pair<int, size_t>> lru;
+    for (size_t i = 0; i < entries.size(); i++) {
+        Entry &e = entries[i];
+        if (e.spilled || e.spilling.valid()) {
+            continue;
+        }
+        total += e.bytes;
+        if (e.texture && !e.reloading.valid() && e.lastUsed < frame - 1) {
+            lru.emplace_back(e.lastUsed, i);
+        }
+    }
+    std::sort(lru.begin(), lru.end());
+    for (auto &[lastUsed, i] : lru) {
+        if (total <= cpuBudget) {
+            break;
+        }
+        Entry *e = &entries[i];
+        total -= e->bytes;
+        e->spilling = pool.submit([e] {
+            std::vector<unsigned char> data = packLevels(e->image, e->levels);
+            e->key = hashBytes(data.data(), data.size(), hashBytes(&e->image.width, sizeof(int)));
+            writeCache(e->key, "texture", data.data(), data.size());
+            std::error_code error;
+            return std::filesystem::file_size(getCachePath(e->key, "texture"), error) == data.size();
+        });
+    }
+}
+
+void TextureStreamer::update(MTL::CommandBuffer *pCmd, size_t budget, size_t gpuBudget, size_t cpuBudget) {
+    frame++;
+    for (size_t i = 0; i < retired.size();) {
+        if (retired[i].frame <= frame) {
+            retired[i].texture->release();
+            retired[i] = retired.back();
+            retired.pop_back();
+        } else {
+            i++;
+        }
+    }
+    if (!receive()) {
+        return;
+    }
+    ResidencyStats before = stats;
+    poll();
+
+    bool full = budget == SIZE_MAX;
+    MTL::BlitCommandEncoder *pBlit = nullptr;
+    if (pCmd) {
+        evict(gpuBudget, pCmd, pBlit);
+    }
+    size_t resident = 0;
+    std::vector<std::pair<float, size_t>> queue;
+    for (size_t i = 0; i < entries.size(); i++) {
+        Entry &e = entries[i];
+        if (e.levels == 0 || e.users.empty()) {
+            continue;
+        }
+        if (!e.texture || getTargetLevel(e, full) < e.top) {
+            adopt(e);
+        }
+        if (!e.texture) {
+            upload(e, full ? 0 : e.tail, pCmd, pBlit);
+        }
+        resident += getGpuBytes(e);
+        if (getTargetLevel(e, full) >= e.top || e.lost) {
+            continue;
+        }
+        if (e.spilled) {
+            if (!e.reloading.valid()) {
+                uint64_t key = e.key;
+                e.reloading = pool.submit([key] {
+                    std::vector<unsigned char> data;
+                    readCache(key, "texture", data);
+                    return data;
+                });
+            }
+            continue;
+        }
+        // how much coarser than its screen size the resident top is
+        float texels = std::max(e.image.width >> e.top, e.image.height >> e.top);
+        queue.emplace_back(e.pixels / texels, i);
+    }
+    std::sort(queue.begin(), queue.end(), std::greater<>());
+
+    size_t uploaded = 0;
+    for (auto &[priority, i] : queue) {
+        Entry &e = entries[i];
+        int target = getTargetLevel(e, full);
+        if (resident + getLevelBytes(e.image, e.top - 1) > gpuBudget) {
+            continue;
+        }
+        int top = e.top;
+        // always at least one level, so a top level larger than the budget still arrives
+        do {
+            size_t size = getLevelBytes(e.image, --top);
+            uploaded += size;
+            resident += size;
+        } while (top > target && uploaded + getLevelBytes(e.image, top - 1) <= budget &&
+                 resident + getLevelBytes(e.image, top - 1) <= gpuBudget);
+        upload(e, top, pCmd, pBlit);
+        if (uploaded >= budget) {
+            break;
+        }
+    }
+    if (pBlit) {
+        pBlit->endEncoding();
+    }
+    spill(cpuBudget);
+
+    stats.gpuBytes = resident;
+    stats.cpuBytes = 0;
+    for (auto &e : entries) {
+        e.pixels = 0.0f;
+        stats.cpuBytes += e.spilled ? 0 : e.bytes;
+    }
+    if (stats.evicted != before.evicted || stats.spilled != before.spilled || stats.reloaded != before.reloaded ||
+        stats.shared != before.shared) {
+        std::cout << "residency: " << (stats.gpuBytes >> 20) << " MB gpu, " << (stats.cpuBytes >> 20) << " MB cpu, "
+                  << stats.evicted << " levels evicted, " << stats.spilled << " spilled, " << stats.reloaded
+                  << " reloaded, " << stats.shared << " shared" << std::endl;
+    }
+}
+
+void TextureStreamer::finish() {
+    pending.wait();
+    update(nullptr, SIZE_MAX, SIZE_MAX, SIZE_MAX);
+}
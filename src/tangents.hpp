@@ -0,0 +1,339 @@
+#include <array>
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <future>
+#include <iostream>
+#include <map>
+#include <tuple>
+#include <vector>
+
+#ifdef REDCUBE_MIKKTSPACE
+#include <mikktspace.h>
+#endif
+
+// bump when the generated tangents change, so cached results are not reused
+const uint64_t TANGENTS_VERSION = 2;
+
+// Tangents of one primitive, xyz + handedness in w. Vertices whose triangles disagree on the tangent are split: the
+// copies are appended after the source vertices and indices is the primitive's re-indexed index buffer.
+struct TangentStreams {
+    std::vector<float> tangents;
+    std::vector<uint32_t> splits;  // source vertex of every appended vertex
+    std::vector<uint32_t> indices; // empty when no vertex was split
+};
+
+// Approximate per vertex tangents, used without REDCUBE_MIKKTSPACE: per triangle UV gradients, weighted by the corner
+// angle, summed per vertex and Gram-Schmidt orthogonalized against the vertex normal. Vertices are never split, so
+// this is not MikkTSpace and does not match tangents baked by MikkTSpace tools on UV seams and mirrored UVs.
+std::vector<float> generateTangents(const std::vector<uint32_t> &indices,
+                                    const std::vector<float> &positions,
+                                    const std::vector<float> &normals,
+                                    const std::vector<float> &uvs) {
+    size_t count = positions.size() / 3;
+    std::vector<glm::vec3> tangents(count, glm::vec3(0.0f));
+    std::vector<glm::vec3> bitangents(count, glm::vec3(0.0f));
+    for (size_t i = 0; i + 2 < indices.size(); i += 3) {
+        uint32_t v[3] = {indices[i], indices[i + 1], indices[i + 2]};
+        if (v[0] >= count || v[1] >= count || v[2] >= count) {
+            continue;
+        }
+        glm::vec3 p[3];
+        glm::vec2 t[3];
+        for (int k = 0; k < 3; k++) {
+            p[k] = glm::make_vec3(&positions[v[k] * 3]);
+            t[k] = glm::make_vec2(&uvs[v[k] * 2]);
+        }
+        glm::vec3 e1 = p[1] - p[0];
+        glm::vec3 e2 = p[2] - p[0];
+        glm::vec2 d1 = t[1] - t[0];
+        glm::vec2 d2 = t[2] - t[0];
+        float det = d1.x * d2.y - d2.x * d1.y;
+        if (fabsf(det) < 1e-20f) {
+            continue;
+        }
+        glm::vec3 sdir = (e1 * d2.y - e2 * d1.y) / det;
+        glm::vec3 tdir = (e2 * d1.x - e1 * d2.x) / det;
+        for (int k = 0; k < 3; k++) {
+            glm::vec3 a = p[(k + 1) % 3] - p[k];
+            glm::vec3 b = p[(k + 2) % 3] - p[k];
+            float la = glm::length(a), lb = glm::length(b);
+            if (la == 0.0f || lb == 0.0f) {
+                continue;
+            }
+            float angle = acosf(glm::clamp(glm::dot(a, b) / (la * lb), -1.0f, 1.0f));
+            tangents[v[k]] += sdir * angle;
+            bitangents[v[k]] += tdir * angle;
+        }
+    }
+
+    std::vector<float> r(count * 4);
+    for (size_t i = 0; i < count; i++) {
+        glm::vec3 n = glm::make_vec3(&normals[i * 3]);
+        glm::vec3 t = tangents[i] - n * glm::dot(n, tangents[i]);
+        float l = glm::length(t);
+        if (l < 1e-12f) {
+            // no usable uv gradient, any vector orthogonal to the normal keeps the frame valid
+            t = fabsf(n.x) < 0.9f ? glm::vec3(1.0f, 0.0f, 0.0f) : glm::vec3(0.0f, 1.0f, 0.0f);
+            t = t - n * glm::dot(n, t);
+            l = glm::length(t);
+        }
+        t /= l;
+        // glTF's v axis points down the image while normal maps have +Y up, so the bitangent is along -v
+        float w = glm::dot(glm::cross(n, t), bitangents[i]) < 0.0f ? 1.0f : -1.0f;
+        r[i * 4] = t.x;
+        r[i * 4 + 1] = t.y;
+        r[i * 4 + 2] = t.z;
+        r[i * 4 + 3] = w;
+    }
+    return r;
+}
+
+#ifdef REDCUBE_MIKKTSPACE
+struct MikkPrimitive {
+    const std::vector<uint32_t> &indices;
+    const std::vector<float> &positions;
+    const std::vector<float> &normals;
+    const std::vector<float> &uvs;
+    std::vector<float> corners; // tangent of every triangle corner
+};
+
+MikkPrimitive &getMikkPrimitive(const SMikkTSpaceContext *context) {
+    return *(MikkPrimitive *)context->m_pUserData;
+}
+
+// Per corner MikkTSpace tangents folded back onto the vertices, splitting a vertex for each extra tangent it gets.
+TangentStreams weldTangents(const std::vector<uint32_t> &indices, const std::vector<float> &corners, size_t count) {
+    TangentStreams r;
+    r.tangents.resize(count * 4);
+    for (size_t i = 0; i < count; i++) {
+        // left to unreferenced vertices
+        r.tangents[i * 4] = r.tangents[i * 4 + 3] = 1.0f;
+    }
+    std::vector<bool> set(count, false);
+    std::map<std::pair<uint32_t, std::array<float, 4>>, uint32_t> copies;
+    std::vector<uint32_t> remapped(indices.size());
+    for (size_t c = 0; c < indices.size(); c++) {
+        uint32_t v = indices[c];
+        const float *t = &corners[c * 4];
+        remapped[c] = v;
+        if (!set[v]) {
+            memcpy(&r.tangents[v * 4], t, 4 * sizeof(float));
+            set[v] = true;
+        } else if (memcmp(&r.tangents[v * 4], t, 4 * sizeof(float)) != 0) {
+            auto [it, inserted] = copies.emplace(std::make_pair(v, std::array<float, 4>{t[0], t[1], t[2], t[3]}),
+                                                 (uint32_t)(count + r.splits.size()));
+            if (inserted) {
+                r.splits.push_back(v);
+                r.tangents.insert(r.tangents.end(), t, t + 4);
+            }
+            remapped[c] = it->second;
+        }
+    }
+    if (!r.splits.empty()) {
+        r.indices = std::move(remapped);
+    }
+    return r;
+}
+#endif
+
+// MikkTSpace tangents, through the reference implementation, when built with REDCUBE_MIKKTSPACE; otherwise, or if it
+// fails, the approximation above.
+TangentStreams buildTangentStreams(const std::vector<uint32_t> &indices,
+                                   const std::vector<float> &positions,
+                                   const std::vector<float> &normals,
+                                   const std::vector<float> &uvs) {
+    size_t count = positions.size() / 3;
+#ifdef REDCUBE_MIKKTSPACE
+    bool valid = indices.size() % 3 == 0 && normals.size() == count * 3 && uvs.size() == count * 2;
+    for (uint32_t v : indices) {
+        valid = valid && v < count;
+    }
+    if (valid && !indices.empty()) {
+        SMikkTSpaceInterface callbacks{};
+        callbacks.m_getNumFaces = [](const SMikkTSpaceContext *context) {
+            return (int)(getMikkPrimitive(context).indices.size() / 3);
+        };
+        callbacks.m_getNumVerticesOfFace = [](const SMikkTSpaceContext *, int) { return 3; };
+        callbacks.m_getPosition = [](const SMikkTSpaceContext *context, float out[], int face, int vertex) {
+            MikkPrimitive &p = getMikkPrimitive(context);
+            memcpy(out, &p.positions[p.indices[face * 3 + vertex] * 3], 3 * sizeof(float));
+        };
+        callbacks.m_getNormal = [](const SMikkTSpaceContext *context, float out[], int face, int vertex) {
+            MikkPrimitive &p = getMikkPrimitive(context);
+            memcpy(out, &p.normals[p.indices[face * 3 + vertex] * 3], 3 * sizeof(float));
+        };
+        // flipped to MikkTSpace's bottom left uv origin, so the bitangent points up the image as glTF expects
+        callbacks.m_getTexCoord = [](const SMikkTSpaceContext *context, float out[], int face, int vertex) {
+            MikkPrimitive &p = getMikkPrimitive(context);
+            const float *uv = &p.uvs[p.indices[face * 3 + vertex] * 2];
+            out[0] = uv[0];
+            out[1] = 1.0f - uv[1];
+        };
+        callbacks.m_setTSpaceBasic = [](const SMikkTSpaceContext *context, const float tangent[], float sign, int face,
+                                        int vertex) {
+            float *out = &getMikkPrimitive(context).corners[(face * 3 + vertex) * 4];
+            memcpy(out, tangent, 3 * sizeof(float));
+            out[3] = sign;
+        };
+        MikkPrimitive primitive{indices, positions, normals, uvs, std::vector<float>(indices.size() * 4)};
+        SMikkTSpaceContext context{&callbacks, &primitive};
+        if (genTangSpaceDefault(&context)) {
+            return weldTangents(indices, primitive.corners, count);
+        }
+    }
+#endif
+    return TangentStreams{generateTangents(indices, positions, normals, uvs)};
+}
+
+// Serialized for the disk cache: split count, index count, then the three arrays.
+std::vector<unsigned char> packTangentStreams(const TangentStreams &t) {
+    uint32_t header[2] = {(uint32_t)t.splits.size(), (uint32_t)t.indices.size()};
+    std::vector<unsigned char> r(sizeof(header) + t.tangents.size() * sizeof(float) +
+                                 (t.splits.size() + t.indices.size()) * sizeof(uint32_t));
+    unsigned char *p = r.data();
+    memcpy(p, header, sizeof(header));
+    p += sizeof(header);
+    memcpy(p, t.tangents.data(), t.tangents.size() * sizeof(float));
+    p += t.tangents.size() * sizeof(float);
+    memcpy(p, t.splits.data(), t.splits.size() * sizeof(uint32_t));
+    p += t.splits.size() * sizeof(uint32_t);
+    memcpy(p, t.indices.data(), t.indices.size() * sizeof(uint32_t));
+    return r;
+}
+
+bool unpackTangentStreams(const std::vector<unsigned char> &bytes, size_t count, TangentStreams &t) {
+    uint32_t header[2];
+    if (bytes.size() < sizeof(header)) {
+        return false;
+    }
+    memcpy(header, bytes.data(), sizeof(header));
+    size_t vertices = count + header[0];
+    if (bytes.size() != sizeof(header) + vertices * 4 * sizeof(float) + ((size_t)header[0] + header[1]) * 4) {
+        return false;
+    }
+    const unsigned char *p = bytes.data() + sizeof(header);
+    t.tangents.resize(vertices * 4);
+    t.splits.resize(header[0]);
+    t.indices.resize(header[1]);
+    memcpy(t.tangents.data(), p, t.tangents.size() * sizeof(float));
+    p += t.tangents.size() * sizeof(float);
+    memcpy(t.splits.data(), p, t.splits.size() * sizeof(uint32_t));
+    p += t.splits.size() * sizeof(uint32_t);
+    memcpy(t.indices.data(), p, t.indices.size() * sizeof(uint32_t));
+    return true;
+}
+
+// Appends the copies of the split vertices to a float stream.
+std::vector<float> appendSplits(std::vector<float> values, int components, const std::vector<uint32_t> &splits) {
+    for (uint32_t v : splits) {
+        for (int c = 0; c < components; c++) {
+            values.push_back(values[v * components + c]);
+        }
+    }
+    return values;
+}
+
+// Adds a TANGENT stream to every normal mapped primitive that comes without one. Primitives are processed on the
+// pool, results are cached on disk under the hash of the source streams.
+void buildTangents(ThreadPool &pool,
+                   std::vector<Mesh> &meshes,
+                   std::vector<Buffer> &geometries,
+                   const std::vector<unsigned char> &buffer) {
+    typedef std::tuple<int, int, int, int> Key;
+    std::map<Key, std::vector<Geometry *>> jobs;
+    for (auto &mesh : meshes) {
+        Geometry *g = mesh.geometry;
+        if (mesh.material->normalTexture < 0 || g->tangent != -1 || g->uv == -1 || g->normal == -1) {
+            continue;
+        }
+        jobs[Key{g->index, g->position, g->normal, g->uv}].push_back(g);
+    }
+    if (jobs.empty()) {
+        return;
+    }
+    // sparse or bufferView-less accessors are expanded here, the workers only read
+    for (auto &[key, g] : jobs) {
+        for (int a : {std::get<0>(key), std::get<1>(key), std::get<2>(key), std::get<3>(key)}) {
+            getData(geometries[a], buffer);
+        }
+    }
+
+    std::atomic<int> cached = 0;
+    std::vector<std::pair<Key, std::future<TangentStreams>>> futures;
+    for (auto &[key, g] : jobs) {
+        Key k = key;
+        futures.emplace_back(key, pool.submit([k, &geometries, &buffer, &cached] {
+            std::vector<uint32_t> indices = readIndices(geometries[std::get<0>(k)], buffer);
+            std::vector<float> positions = readFloats(geometries[std::get<1>(k)], buffer);
+            std::vector<float> normals = readFloats(geometries[std::get<2>(k)], buffer);
+            std::vector<float> uvs = readFloats(geometries[std::get<3>(k)], buffer);
+
+            uint64_t hash = hashBytes(indices.data(), indices.size() * sizeof(uint32_t));
+            hash = hashBytes(positions.data(), positions.size() * sizeof(float), hash);
+            hash = hashBytes(normals.data(), normals.size() * sizeof(float), hash);
+            hash = hashBytes(uvs.data(), uvs.size() * sizeof(float), hash);
+#ifdef REDCUBE_MIKKTSPACE
+            const uint64_t version = TANGENTS_VERSION | 1ull << 32;
+#else
+            const uint64_t version = TANGENTS_VERSION;
+#endif
+            hash = hashBytes(&version, sizeof(version), hash);
+
+            TangentStreams r;
+            std::vector<unsigned char> bytes;
+            if (readCache(hash, "tangents", bytes) && unpackTangentStreams(bytes, positions.size() / 3, r)) {
+                cached++;
+                return r;
+            }
+            r = buildTangentStreams(indices, positions, normals, uvs);
+            bytes = packTangentStreams(r);
+            writeCache(hash, "tangents", bytes.data(), bytes.size());
+            return r;
+        }));
+    }
+
+    // wait for every job before appending, the workers index into geometries
+    std::vector<TangentStreams> results;
+    for (auto &[key, f] : futures) {
+        results.push_back(f.get());
+    }
+    size_t splits = 0;
+    for (size_t i = 0; i < futures.size(); i++) {
+        TangentStreams &t = results[i];
+        const Key &key = futures[i].first;
+        geometries.push_back(makeFloatBuffer(t.tangents, 4));
+        int tangent = geometries.size() - 1;
+        std::array<int, 4> split{std::get<0>(key), std::get<1>(key), std::get<2>(key), std::get<3>(key)};
+        if (!t.splits.empty()) {
+            // the primitive gets its own copies of the streams, with the split vertices appended
+            Buffer b{0, (int)(t.indices.size() * 4), (int)t.indices.size(), 4, 0};
+            b.componentType = 5125;
+            b.data.resize(b.length);
+            memcpy(b.data.data(), t.indices.data(), b.length);
+            geometries.push_back(std::move(b));
+            split[0] = geometries.size() - 1;
+            for (int a = 1; a < 4; a++) {
+                int components = a == 3 ? 2 : 3;
+                geometries.push_back(
+                    makeFloatBuffer(appendSplits(readFloats(geometries[split[a]], buffer), components, t.splits),
+                                    components));
+                split[a] = geometries.size() - 1;
+            }
+            splits += t.splits.size();
+        }
+        for (Geometry *g : jobs[key]) {
+            g->index = split[0];
+            g->position = split[1];
+            g->normal = split[2];
+            g->uv = split[3];
+            g->tangent = tangent;
+        }
+    }
+    std::cout << "tangents: generated " << futures.size() << " streams, " << cached << " from cache";
+    if (splits > 0) {
+        std::cout << ", " << splits << " vertices split on tangent seams";
+    }
+    std::cout << std::endl;
+}
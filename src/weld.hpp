@@ -0,0 +1,179 @@
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <future>
+#include <iostream>
+#include <map>
+#include <tuple>
+#include <vector>
+
+struct WeldResult {
+    std::vector<uint32_t> indices;
+    std::vector<std::vector<float>> streams;
+    size_t before = 0;
+};
+
+// Merges vertices whose attributes all fall into the same epsilon grid cell, the first one found is kept. Vertices
+// are emitted in the order of their first use, so unreferenced ones are dropped as well.
+WeldResult weldVertices(const std::vector<uint32_t> &indices,
+                        const std::vector<std::vector<float>> &streams,
+                        const std::vector<int> &components,
+                        float epsilon) {
+    WeldResult r;
+    size_t count = streams[0].size() / components[0];
+    r.before = count;
+    int size = 0;
+    for (int c : components) {
+        size += c;
+    }
+
+    std::vector<int64_t> cells(count * size);
+    std::vector<uint64_t> hashes(count);
+    for (size_t v = 0; v < count; v++) {
+        int64_t *cell = &cells[v * size];
+        int k = 0;
+        for (size_t s = 0; s < streams.size(); s++) {
+            for (int c = 0; c < components[s]; c++, k++) {
+                cell[k] = (int64_t)floorf(streams[s][v * components[s] + c] / epsilon + 0.5f);
+            }
+        }
+        hashes[v] = hashBytes(cell, size * sizeof(int64_t));
+    }
+
+    // open addressing, slots hold the welded vertex id + 1
+    size_t capacity = 1;
+    while (capacity < count * 2) {
+        capacity *= 2;
+    }
+    std::vector<uint32_t> table(capacity, 0);
+    std::vector<uint32_t> remap(count, UINT32_MAX);
+    std::vector<uint32_t> source;
+    r.indices.resize(indices.size());
+    for (size_t i = 0; i < indices.size(); i++) {
+        uint32_t v = indices[i];
+        if (v >= count) {
+            r.indices[i] = 0;
+            continue;
+        }
+        if (remap[v] == UINT32_MAX) {
+            size_t slot = hashes[v] & (capacity - 1);
+            while (table[slot] != 0) {
+                uint32_t w = source[table[slot] - 1];
+                if (hashes[w] == hashes[v] && memcmp(&cells[w * size], &cells[v * size], size * sizeof(int64_t)) == 0) {
+                    break;
+                }
+                slot = (slot + 1) & (capacity - 1);
+            }
+            if (table[slot] == 0) {
+                source.push_back(v);
+                table[slot] = source.size();
+            }
+            remap[v] = table[slot] - 1;
+        }
+        r.indices[i] = remap[v];
+    }
+
+    r.streams.resize(streams.size());
+    for (size_t s = 0; s < streams.size(); s++) {
+        int n = components[s];
+        r.streams[s].resize(source.size() * n);
+        for (size_t v = 0; v < source.size(); v++) {
+            memcpy(&r.streams[s][v * n], &streams[s][source[v] * n], n * sizeof(float));
+        }
+    }
+    return r;
+}
+
+Buffer makeFloatBuffer(const std::vector<float> &values, int components) {
+    Buffer b{0, (int)(values.size() * sizeof(float)), (int)values.size() / components, 4, 0};
+    b.components = components;
+    b.data.resize(b.length);
+    memcpy(b.data.data(), values.data(), b.length);
+    return b;
+}
+
+// Welds every primitive on the pool; welded streams and 32 bit indices are appended as new accessors, since the
+// source ones may be shared. compactIndices() narrows the indices again afterwards.
+void weldMeshes(ThreadPool &pool,
+                std::vector<Mesh> &meshes,
+                std::vector<Buffer> &geometries,
+                const std::vector<unsigned char> &buffer,
+                float epsilon) {
+    typedef std::tuple<int, int, int, int, int> Key;
+    std::map<Key, std::vector<Geometry *>> jobs;
+    for (auto &mesh : meshes) {
+        Geometry *g = mesh.geometry;
+        jobs[Key{g->index, g->position, g->normal, g->uv, g->tangent}].push_back(g);
+    }
+    for (auto &[key, g] : jobs) {
+        for (int a : {std::get<0>(key), std::get<1>(key), std::get<2>(key), std::get<3>(key), std::get<4>(key)}) {
+            if (a != -1) {
+                getData(geometries[a], buffer);
+            }
+        }
+    }
+
+    std::vector<std::pair<Key, std::future<WeldResult>>> futures;
+    for (auto &[key, g] : jobs) {
+        Key k = key;
+        futures.emplace_back(key, pool.submit([k, &geometries, &buffer, epsilon] {
+            std::vector<std::vector<float>> streams;
+            std::vector<int> components;
+            for (int a : {std::get<1>(k), std::get<2>(k), std::get<3>(k), std::get<4>(k)}) {
+                if (a != -1) {
+                    streams.push_back(readFloats(geometries[a], buffer));
+                    components.push_back(geometries[a].components);
+                }
+            }
+            return weldVertices(readIndices(geometries[std::get<0>(k)], buffer), streams, components, epsilon);
+        }));
+    }
+
+    std::vector<WeldResult> results;
+    for (auto &[key, f] : futures) {
+        results.push_back(f.get());
+    }
+    size_t before = 0;
+    size_t after = 0;
+    for (size_t i = 0; i < futures.size(); i++) {
+        WeldResult &w = results[i];
+        size_t welded = w.streams[0].size() / geometries[std::get<1>(futures[i].first)].components;
+        before += w.before;
+        after += welded;
+        if (welded == w.before) {
+            continue;
+        }
+
+        Buffer indices{0, (int)(w.indices.size() * 4), (int)w.indices.size(), 4, 0};
+        indices.componentType = 5125;
+        indices.data.resize(indices.length);
+        memcpy(indices.data.data(), w.indices.data(), indices.length);
+        geometries.push_back(std::move(indices));
+        int index = geometries.size() - 1;
+
+        std::vector<int> attributes;
+        int s = 0;
+        for (int a : {std::get<1>(futures[i].first),
+                      std::get<2>(futures[i].first),
+                      std::get<3>(futures[i].first),
+                      std::get<4>(futures[i].first)}) {
+            if (a == -1) {
+                attributes.push_back(-1);
+                continue;
+            }
+            geometries.push_back(makeFloatBuffer(w.streams[s++], geometries[a].components));
+            attributes.push_back(geometries.size() - 1);
+        }
+        for (Geometry *g : jobs[futures[i].first]) {
+            g->index = index;
+            g->position = attributes[0];
+            g->normal = attributes[1];
+            g->uv = attributes[2];
+            g->tangent = attributes[3];
+        }
+    }
+    if (before > 0) {
+        std::cout << "weld: removed " << before - after << " of " << before << " vertices" << std::endl;
+    }
+}
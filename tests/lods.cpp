@@ -0,0 +1,66 @@
+#include "pipeline.hpp"
+#include "test.hpp"
+
+// welded unit UV sphere, closed and manifold so no vertex is locked but the poles' neighbours
+void buildSphere(int rings, int segments, std::vector<uint32_t> &indices, std::vector<float> &positions) {
+    positions.insert(positions.end(), {0.0f, 1.0f, 0.0f});
+    for (int r = 1; r < rings; r++) {
+        float phi = M_PI * r / rings;
+        for (int s = 0; s < segments; s++) {
+            float theta = 2.0f * M_PI * s / segments;
+            positions.insert(positions.end(), {sinf(phi) * cosf(theta), cosf(phi), sinf(phi) * sinf(theta)});
+        }
+    }
+    positions.insert(positions.end(), {0.0f, -1.0f, 0.0f});
+    uint32_t bottom = positions.size() / 3 - 1;
+    auto ring = [segments](int r, int s) { return (uint32_t)(1 + (r - 1) * segments + s % segments); };
+    for (int s = 0; s < segments; s++) {
+        indices.insert(indices.end(), {0, ring(1, s + 1), ring(1, s)});
+        for (int r = 1; r < rings - 1; r++) {
+            indices.insert(indices.end(), {ring(r, s), ring(r, s + 1), ring(r + 1, s)});
+            indices.insert(indices.end(), {ring(r, s + 1), ring(r + 1, s + 1), ring(r + 1, s)});
+        }
+        indices.insert(indices.end(), {bottom, ring(rings - 1, s), ring(rings - 1, s + 1)});
+    }
+}
+
+// every level has fewer triangles than the one before and an error at least as large, and stays a valid index
+// buffer over the source vertices
+void testSphereChain() {
+    std::vector<uint32_t> indices;
+    std::vector<float> positions;
+    buildSphere(48, 96, indices, positions);
+    std::string report;
+    auto chain = buildLodChain(indices, positions, report);
+    printf("sphere: %s\n", report.c_str());
+    CHECK(chain.size() >= 2);
+    size_t previous = indices.size();
+    float error = 0.0f;
+    for (auto &[lod, e] : chain) {
+        CHECK(lod.size() % 3 == 0);
+        CHECK(lod.size() < previous);
+        CHECK(e >= error);
+        for (uint32_t v : lod) {
+            CHECK(v < positions.size() / 3);
+        }
+        previous = lod.size();
+        error = e;
+    }
+    // the quadric error sums over the merged planes, still under the radius at the coarsest level
+    CHECK(error > 0.0f && error < 1.0f);
+}
+
+// below kLodMinTriangles nothing is built
+void testSmallMesh() {
+    std::vector<uint32_t> indices;
+    std::vector<float> positions;
+    buildSphere(8, 16, indices, positions);
+    std::string report;
+    CHECK(buildLodChain(indices, positions, report).empty());
+}
+
+int main() {
+    testSphereChain();
+    testSmallMesh();
+    return failures;
+}
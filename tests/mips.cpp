@@ -0,0 +1,83 @@
+#include "pipeline.hpp"
+#include "test.hpp"
+
+// Levels 1..3 of a 9x6 source, stored from an independent double precision reference: every output texel is the
+// exact area average of the source texels under its footprint (exact sRGB curves, no tables). The odd width and the
+// odd height of the 4x3 level check that the last column and row are weighted in, not dropped.
+const std::vector<std::vector<int>> kColorLevels{
+    {82, 129, 166, 24, 148, 151, 164, 66, 147, 160, 155, 109, 137, 170, 106, 151, 159, 166, 154, 70, 133, 150, 152, 112,
+     170, 157, 153, 155, 126, 156, 148, 197, 126, 174, 161, 116, 128, 149, 154, 158, 132, 156, 154, 201, 150, 145, 145,
+     186},
+    {132, 154, 159, 91, 145, 158, 145, 166},
+    {139, 156, 152, 129},
+};
+const std::vector<std::vector<int>> kLinearLevels{
+    {64, 117, 156, 24, 130, 126, 136, 66, 125, 135, 131, 109, 105, 144, 83, 151, 135, 131, 127, 70, 108, 132, 129, 112,
+     152, 134, 130, 155, 96, 135, 131, 197, 107, 160, 142, 116, 100, 125, 135, 158, 107, 132, 128, 201, 129, 125, 121,
+     186},
+    {107, 132, 138, 91, 119, 134, 121, 166},
+    {113, 133, 130, 129},
+};
+const std::vector<std::vector<int>> kNormalLevels{
+    {57, 90, 227, 255, 127, 118, 255, 255, 148, 137, 253, 255, 94, 164, 245, 255, 124, 131, 255, 255, 103, 146, 251,
+     255, 138, 121, 254, 255, 140, 147, 253, 255, 168, 115, 248, 255, 122, 133, 255, 255, 83, 146, 245, 255, 148, 137,
+     253, 255},
+    {116, 122, 254, 255, 125, 142, 254, 255},
+    {120, 132, 255, 255},
+};
+
+const int kWidth = 9, kHeight = 6;
+
+std::vector<unsigned char> buildSource(TextureRole role) {
+    std::vector<unsigned char> r;
+    for (int y = 0; y < kHeight; y++) {
+        for (int x = 0; x < kWidth; x++) {
+            if (role == TextureNormal) {
+                r.insert(r.end(), {(unsigned char)(80 + (x * 29 + y * 13) % 97),
+                                   (unsigned char)(84 + (x * 17 + y * 41) % 89),
+                                   (unsigned char)(150 + (x + y) * 7 % 55),
+                                   255});
+            } else {
+                for (int c = 0; c < 3; c++) {
+                    r.push_back((x * 37 + y * 71 + c * 53 + x * y * 11) % 256);
+                }
+                r.push_back((x * 19 + y * 23) % 256);
+            }
+        }
+    }
+    return r;
+}
+
+// every channel of every level within tolerance of the reference
+int testChain(TextureRole role, const std::vector<std::vector<int>> &reference, int tolerance) {
+    std::vector<unsigned char> source = buildSource(role);
+    Image image(kWidth, kHeight, 4, source.data());
+    buildMipChain(image, role);
+    CHECK(image.mips.size() == reference.size());
+    int worst = 0;
+    for (size_t level = 0; level < image.mips.size() && level < reference.size(); level++) {
+        CHECK(image.mips[level].size() == reference[level].size());
+        for (size_t i = 0; i < image.mips[level].size() && i < reference[level].size(); i++) {
+            worst = std::max(worst, abs(image.mips[level][i] - reference[level][i]));
+        }
+    }
+    CHECK(worst <= tolerance);
+    return worst;
+}
+
+int main() {
+    // the lookup tables quantize the linear value to 12 bits, which may cost one step of 8 bit sRGB
+    printf("color: max difference %d\n", testChain(TextureColor, kColorLevels, 1));
+    printf("linear: max difference %d\n", testChain(TextureLinear, kLinearLevels, 1));
+    printf("normal: max difference %d\n", testChain(TextureNormal, kNormalLevels, 1));
+    // averaging sRGB values as if they were linear would be far off
+    std::vector<unsigned char> source = buildSource(TextureColor);
+    Image image(kWidth, kHeight, 4, source.data());
+    buildMipChain(image, TextureLinear);
+    int difference = 0;
+    for (size_t i = 0; i < image.mips[0].size(); i++) {
+        difference = std::max(difference, abs(image.mips[0][i] - kColorLevels[0][i]));
+    }
+    CHECK(difference > 8);
+    return failures;
+}
@@ -0,0 +1,44 @@
+// the asset pipeline headers in renderer.cpp's order, without the ones that need Metal
+#include <math.h>
+
+#include <array>
+#include <fstream>
+#include <future>
+#include <iostream>
+#include <json/json.hpp>
+#include <queue>
+#include <tuple>
+using json = nlohmann::json;
+
+#include <glm/gtc/type_ptr.hpp>
+#include <glm/vec3.hpp>
+#include <glm/vec4.hpp>
+#define GLM_ENABLE_EXPERIMENTAL
+#include <glm/gtx/quaternion.hpp>
+#include <glm/gtx/string_cast.hpp>
+
+#include "objects.hpp"
+#include "pool.hpp"
+#include "request.hpp"
+#include "utils.hpp"
+#include "simd.hpp"
+#include "meshopt.hpp"
+#include "prune.hpp"
+#include "ktx2.hpp"
+#include "decoders.hpp"
+#include "creators.hpp"
+#include "accessors.hpp"
+#include "draco.hpp"
+#include "morph.hpp"
+#include "cache.hpp"
+#include "weld.hpp"
+#include "tangents.hpp"
+#include "simplify.hpp"
+#include "quantize.hpp"
+#include "indices.hpp"
+#include "meshlets.hpp"
+#include "batch.hpp"
+#include "mips.hpp"
+#include "bc.hpp"
+#include "channels.hpp"
+#include "dedup.hpp"
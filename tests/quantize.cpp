@@ -0,0 +1,108 @@
+#include <random>
+
+#include "pipeline.hpp"
+#include "test.hpp"
+
+float dot3(const float *a, const float *b) {
+    return a[0] * b[0] + a[1] * b[1] + a[2] * b[2];
+}
+
+// atan2 keeps its precision for tiny angles, acos of the dot product does not
+float angle3(const float *a, const float *b) {
+    float c[3] = {a[1] * b[2] - a[2] * b[1], a[2] * b[0] - a[0] * b[2], a[0] * b[1] - a[1] * b[0]};
+    return atan2f(sqrtf(dot3(c, c)), dot3(a, b));
+}
+
+void normalize3(float *v) {
+    float l = sqrtf(dot3(v, v));
+    for (int c = 0; c < 3; c++) {
+        v[c] /= l;
+    }
+}
+
+// quantizeVertices followed by decodeVertex, the CPU twin of vertexQuantized, stays within half a quantization
+// step for positions and uvs and within a small angle for the octahedral normals and tangents
+void testRoundTrip(bool withUvs, bool withTangents) {
+    std::mt19937 random(26);
+    std::uniform_real_distribution<float> unit(-1.0f, 1.0f);
+    size_t count = 4096;
+    std::vector<float> positions, normals, uvs, tangents;
+    for (size_t i = 0; i < count; i++) {
+        float n[3] = {unit(random), unit(random), unit(random)};
+        float t[3] = {unit(random), unit(random), unit(random)};
+        // the axes and the octahedron's folded edges are the interesting cases
+        if (i < 6) {
+            n[0] = n[1] = n[2] = 0.0f;
+            n[i / 2] = i % 2 ? -1.0f : 1.0f;
+        } else if (i < 10) {
+            n[0] = i & 1 ? 0.5f : -0.5f;
+            n[1] = i & 2 ? 0.5f : -0.5f;
+            n[2] = -0.70710678f;
+        }
+        normalize3(n);
+        normalize3(t);
+        positions.insert(positions.end(), {unit(random) * 100.0f, unit(random) * 0.01f + 5.0f, unit(random) * 3.0f});
+        normals.insert(normals.end(), n, n + 3);
+        if (withUvs) {
+            uvs.insert(uvs.end(), {unit(random) * 4.0f, unit(random) + 1.0f});
+        }
+        if (withTangents) {
+            tangents.insert(tangents.end(), {t[0], t[1], t[2], i % 3 ? 1.0f : -1.0f});
+        }
+    }
+
+    Quantization q;
+    std::vector<QuantizedVertex> vertices = quantizeVertices(positions, normals, uvs, tangents, q);
+    CHECK(vertices.size() == count);
+    CHECK(q.hasTangent == (withTangents ? 1.0f : 0.0f));
+
+    float maxAngle = 0.0f;
+    for (size_t i = 0; i < count; i++) {
+        float position[3], normal[3], uv[2], tangent[4];
+        decodeVertex(vertices[i], q, position, normal, uv, tangent);
+        for (int c = 0; c < 3; c++) {
+            CHECK(fabsf(position[c] - positions[i * 3 + c]) <= q.positionScale[c] * 0.5f + 1e-5f);
+        }
+        if (withUvs) {
+            for (int c = 0; c < 2; c++) {
+                CHECK(fabsf(uv[c] - uvs[i * 2 + c]) <= q.uvScale[c] * 0.5f + 1e-6f);
+            }
+        } else {
+            CHECK(uv[0] == 0.0f && uv[1] == 0.0f);
+        }
+        CHECK(fabsf(dot3(normal, normal) - 1.0f) < 1e-5f);
+        maxAngle = fmaxf(maxAngle, angle3(normal, &normals[i * 3]));
+        if (withTangents) {
+            maxAngle = fmaxf(maxAngle, angle3(tangent, &tangents[i * 4]));
+            CHECK(tangent[3] == tangents[i * 4 + 3]);
+        } else {
+            CHECK(tangent[3] == 1.0f);
+        }
+    }
+    // snorm16 octahedral encoding is good to about 1e-4 rad
+    CHECK(maxAngle < 2e-4f);
+    printf("round trip uvs %d tangents %d: max angle %g rad\n", withUvs, withTangents, maxAngle);
+}
+
+// a flat axis keeps a zero scale and decodes exactly
+void testDegenerateBounds() {
+    std::vector<float> positions{0.0f, 2.0f, 1.0f, 1.0f, 2.0f, 1.0f};
+    std::vector<float> normals{0.0f, 1.0f, 0.0f, 0.0f, 1.0f, 0.0f};
+    Quantization q;
+    std::vector<QuantizedVertex> vertices = quantizeVertices(positions, normals, {}, {}, q);
+    for (size_t i = 0; i < vertices.size(); i++) {
+        float position[3], normal[3], uv[2], tangent[4];
+        decodeVertex(vertices[i], q, position, normal, uv, tangent);
+        CHECK(position[0] == positions[i * 3]);
+        CHECK(position[1] == 2.0f && position[2] == 1.0f);
+        CHECK(normal[1] == 1.0f);
+    }
+}
+
+int main() {
+    testRoundTrip(true, true);
+    testRoundTrip(true, false);
+    testRoundTrip(false, true);
+    testDegenerateBounds();
+    return failures;
+}
@@ -0,0 +1,122 @@
+#include <cstdint>
+
+#include "ring.hpp"
+#include "test.hpp"
+
+// stands in for MTL::Buffer, remembering how far it was flushed
+struct MockBuffer {
+    std::vector<unsigned char> bytes;
+    size_t flushed = 0;
+    int *live;
+
+    void *contents() {
+        return bytes.data();
+    }
+    size_t length() {
+        return bytes.size();
+    }
+    void release() {
+        (*live)--;
+        delete this;
+    }
+};
+
+struct MockDevice {
+    int created = 0;
+    int live = 0;
+};
+
+template <>
+struct RingTraits<MockDevice, MockBuffer> {
+    static MockBuffer *newBuffer(MockDevice *pDevice, size_t size) {
+        pDevice->created++;
+        pDevice->live++;
+        return new MockBuffer{std::vector<unsigned char>(size), 0, &pDevice->live};
+    }
+    static void flush(MockBuffer *pBuffer, size_t length) {
+        pBuffer->flushed = length;
+    }
+};
+
+struct Constants {
+    float values[68]; // 272 bytes, two aligned slots each
+};
+
+// allocations are aligned, inside their buffer, and flushed up to the last one by end()
+void testAllocate() {
+    MockDevice device;
+    {
+        FrameRing<MockDevice, MockBuffer> ring(&device, 4096, 3);
+        CHECK(device.created == 3);
+        ring.begin(0);
+        auto a = ring.push(Constants{});
+        auto b = ring.push(Constants{});
+        auto c = ring.allocate(16, 64);
+        CHECK(a.offset == 0 && b.offset == 512 && c.offset == 832);
+        CHECK(a.buffer == b.buffer && b.buffer == c.buffer);
+        CHECK((unsigned char *)b.data == (unsigned char *)b.buffer->contents() + 512);
+        ring.end();
+        CHECK(c.buffer->flushed == 848);
+        CHECK(ring.getStats().used == 848 && ring.getStats().overflows == 0);
+    }
+    CHECK(device.live == 0);
+}
+
+// a frame past its region chains a buffer, flushing the full one first, and the regions grow for later frames
+void testOverflowAndGrow() {
+    MockDevice device;
+    {
+        FrameRing<MockDevice, MockBuffer> ring(&device, 1024, 3);
+        ring.begin(0);
+        std::vector<FrameRing<MockDevice, MockBuffer>::Allocation> allocations;
+        for (int i = 0; i < 3; i++) {
+            allocations.push_back(ring.push(Constants{}));
+        }
+        CHECK(allocations[1].buffer == allocations[0].buffer);
+        CHECK(allocations[2].buffer != allocations[0].buffer && allocations[2].offset == 0);
+        CHECK(allocations[0].buffer->flushed == 784);
+        for (auto &a : allocations) {
+            CHECK(a.offset + sizeof(Constants) <= a.buffer->length());
+        }
+        ring.end();
+        RingStats stats = ring.getStats();
+        CHECK(stats.overflows == 1 && stats.grows == 1);
+        CHECK(stats.used == 1296 && stats.capacity == 2048);
+
+        // every frame is rebuilt at the new size once, then nothing is created
+        for (int frame = 1; frame < 9; frame++) {
+            ring.begin(frame % 3);
+            for (int i = 0; i < 3; i++) {
+                auto a = ring.push(Constants{});
+                CHECK(a.buffer->length() == 2048 && a.offset == (size_t)i * 512);
+            }
+            ring.end();
+        }
+        stats = ring.getStats();
+        CHECK(stats.overflows == 1 && stats.grows == 1 && stats.peak == 1296);
+        CHECK(device.created == 3 + 1 + 3);
+        CHECK(device.live == 3);
+    }
+    CHECK(device.live == 0);
+}
+
+// an allocation larger than the region gets a buffer of its own size
+void testLargeAllocation() {
+    MockDevice device;
+    {
+        FrameRing<MockDevice, MockBuffer> ring(&device, 1024, 2);
+        ring.begin(0);
+        auto a = ring.allocate(4000);
+        CHECK(a.offset == 0 && a.buffer->length() == 4000);
+        ring.end();
+        CHECK(ring.getStats().capacity == 4096);
+    }
+    CHECK(device.live == 0);
+}
+
+int main() {
+    testAllocate();
+    testOverflowAndGrow();
+    testLargeAllocation();
+    return failures;
+}
@@ -0,0 +1,105 @@
+#define NS_PRIVATE_IMPLEMENTATION
+#define MTL_PRIVATE_IMPLEMENTATION
+#include <Metal/Metal.hpp>
+
+#include "pipeline.hpp"
+#include "streamer.hpp"
+#include "test.hpp"
+
+// Headless residency checks on the default Metal device: eviction has to give the memory back, which the streamer's
+// own counters cannot show, so the device's allocated size is compared.
+
+const int kSize = 1024;
+const size_t kTopBytes = (size_t)kSize * kSize * 4;
+
+std::future<std::vector<Image>> makeImages(ThreadPool &pool) {
+    std::vector<Image> images{Image(kSize, kSize, 4, (unsigned char *)malloc(kTopBytes))};
+    for (size_t i = 0; i < kTopBytes; i++) {
+        images[0].buffer[i] = (unsigned char)(i * 2654435761u >> 24);
+    }
+    dedupImages(pool, images, {TextureColor});
+    buildMipChain(images[0], TextureColor);
+    std::promise<std::vector<Image>> promise;
+    promise.set_value(std::move(images));
+    return promise.get_future();
+}
+
+// one frame drawing texture 0 at pixels (none when 0), waited on so retired textures are released on schedule
+void runFrame(MTL::CommandQueue *pQueue, TextureStreamer &streamer, float pixels, size_t gpuBudget) {
+    MTL::CommandBuffer *pCmd = pQueue->commandBuffer();
+    if (pixels > 0.0f) {
+        streamer.request(0, pixels);
+    }
+    streamer.update(pCmd, 64 << 20, gpuBudget, SIZE_MAX);
+    pCmd->commit();
+    pCmd->waitUntilCompleted();
+}
+
+// a texture evicted by its only user is freed, the shared map keeps nothing of the full size
+void testEvictionFrees(MTL::Device *pDevice, MTL::CommandQueue *pQueue, ThreadPool &pool) {
+    {
+        TextureStreamer streamer(pDevice, pool, {0}, {TextureColor}, makeImages(pool), nullptr, 3);
+        for (int f = 0; f < 4; f++) {
+            runFrame(pQueue, streamer, kSize, SIZE_MAX);
+        }
+        size_t full = pDevice->currentAllocatedSize();
+        CHECK(streamer.getStats().gpuBytes > kTopBytes);
+        for (int f = 0; f < 8; f++) {
+            runFrame(pQueue, streamer, 0.0f, 0);
+        }
+        size_t evicted = pDevice->currentAllocatedSize();
+        printf("single: %zu KB held at full size, %zu KB evicted\n", full >> 10, evicted >> 10);
+        CHECK(streamer.getStats().gpuBytes < kTopBytes / 16);
+        CHECK(evicted + kTopBytes <= full);
+        CHECK(sharedTextures.size() == 1 && sharedTextures.begin()->second.top > 0);
+    }
+    CHECK(sharedTextures.empty());
+}
+
+// a shared texture stays while another renderer draws it and goes with the last one evicting it
+void testSharedEviction(MTL::Device *pDevice, MTL::CommandQueue *pQueue, ThreadPool &pool) {
+    TextureStreamer a(pDevice, pool, {0}, {TextureColor}, makeImages(pool), nullptr, 3);
+    for (int f = 0; f < 4; f++) {
+        runFrame(pQueue, a, kSize, SIZE_MAX);
+    }
+    TextureStreamer b(pDevice, pool, {0}, {TextureColor}, makeImages(pool), nullptr, 3);
+    runFrame(pQueue, b, kSize, SIZE_MAX);
+    CHECK(b.getStats().shared == 1);
+    CHECK(a.getTexture(0, 0) == b.getTexture(0, 0));
+    size_t full = pDevice->currentAllocatedSize();
+
+    for (int f = 0; f < 8; f++) {
+        runFrame(pQueue, a, 0.0f, 0);
+        runFrame(pQueue, b, kSize, SIZE_MAX);
+    }
+    size_t drawn = pDevice->currentAllocatedSize();
+    CHECK(a.getStats().gpuBytes < kTopBytes / 16);
+    CHECK(drawn + kTopBytes > full);
+
+    for (int f = 0; f < 8; f++) {
+        runFrame(pQueue, a, 0.0f, 0);
+        runFrame(pQueue, b, 0.0f, 0);
+    }
+    size_t evicted = pDevice->currentAllocatedSize();
+    printf("shared: %zu KB held at full size, %zu KB while b draws, %zu KB evicted\n", full >> 10, drawn >> 10,
+           evicted >> 10);
+    CHECK(evicted + kTopBytes <= full);
+    CHECK(sharedTextures.begin()->second.top > 0);
+}
+
+int main() {
+    NS::AutoreleasePool *pAutoreleasePool = NS::AutoreleasePool::alloc()->init();
+    MTL::Device *pDevice = MTL::CreateSystemDefaultDevice();
+    if (!pDevice) {
+        printf("no Metal device, skipped\n");
+        return 0;
+    }
+    MTL::CommandQueue *pQueue = pDevice->newCommandQueue();
+    ThreadPool pool;
+    testEvictionFrees(pDevice, pQueue, pool);
+    testSharedEviction(pDevice, pQueue, pool);
+    pQueue->release();
+    pDevice->release();
+    pAutoreleasePool->release();
+    return failures;
+}
@@ -0,0 +1,13 @@
+#include <cmath>
+#include <cstdio>
+
+// CHECK counts failures instead of stopping, so one run reports every broken case; main returns the count
+int failures = 0;
+
+#define CHECK(condition)                                                         \
+    do {                                                                         \
+        if (!(condition)) {                                                      \
+            printf("%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #condition); \
+            failures++;                                                          \
+        }                                                                        \
+    } while (0)